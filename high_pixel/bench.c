@@ -0,0 +1,350 @@
+/*
+	Engines benchmark, built from the library source with the heap counters
+	compiled in, see highpixel.c.
+*/
+#define HIGH_PIXEL_BENCH
+#include "highpixel.c"
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const char* dist_names[DIST_COUNT] = {
+    "uniform", "uniform8", "ascending", "descending", "constant", "heavy_tail"};
+
+typedef int32_t (*bench_fn)(const image_t* image, heap_t* high_pixels);
+
+static int32_t bench_auto(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_AUTO);
+}
+
+static int32_t bench_heap(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_HEAP);
+}
+
+static int32_t bench_heap_scalar(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_with(image, high_pixels, SCAN_KERNEL_SCALAR);
+}
+
+/* the kernel AVX-512 machines would run without the AVX-512 one */
+static int32_t bench_heap_avx2(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_with(image, high_pixels, SCAN_KERNEL_AVX2);
+}
+
+static int32_t bench_select(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_SELECT);
+}
+
+static int32_t bench_histogram(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_HISTOGRAM);
+}
+
+static int32_t bench_packed(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_PACKED);
+}
+
+static int32_t bench_small(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_SMALL);
+}
+
+static int32_t bench_parallel(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_parallel(image, high_pixels, 0);
+}
+
+static int32_t bench_parallel_shared(const image_t* image,
+                                     heap_t* high_pixels) {
+  return build_high_pixels_parallel_shared(image, high_pixels, 0);
+}
+
+/*
+	steady state: the runs repeat the same frame, the threshold always
+	holds. The state is primed, untimed, on the frame and X of the runs.
+*/
+static high_pixels_temporal_t bench_temporal_state;
+
+static int32_t bench_temporal_prime(const image_t* image,
+                                    heap_t* high_pixels) {
+  init_high_pixels_temporal(&bench_temporal_state);
+
+  return build_high_pixels_temporal(image, high_pixels, &bench_temporal_state);
+}
+
+static int32_t bench_temporal(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_temporal(image, high_pixels, &bench_temporal_state);
+}
+
+static int32_t bench_approx(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_approx(image, high_pixels, 0) < 0 ? -1 : 0;
+}
+
+/* top X and bottom X in the same pass */
+static int32_t bench_extreme(const image_t* image, heap_t* high_pixels) {
+  static heap_t low;
+
+  if (low.capacity != high_pixels->capacity) {
+    free_heap(&low);
+    if (init_heap(&low, high_pixels->capacity)) return -1;
+  }
+
+  low.size = 0;
+
+  return build_extreme_pixels(image, high_pixels, &low);
+}
+
+static const struct {
+  const char* name;
+  bench_fn fn;
+  bench_fn prime; /* untimed first run of each combination, or NULL */
+} bench_engines[] = {
+    {"auto", bench_auto},
+    {"heap", bench_heap},
+    {"heap_scalar", bench_heap_scalar},
+    {"heap_avx2", bench_heap_avx2},
+    {"select", bench_select},
+    {"histogram", bench_histogram},
+    {"packed", bench_packed},
+    {"small", bench_small},
+    {"parallel", bench_parallel},
+    {"parallel_shared", bench_parallel_shared},
+    {"temporal", bench_temporal, bench_temporal_prime},
+    {"extreme", bench_extreme},
+    {"approx", bench_approx},
+};
+
+#define BENCH_ENGINES (sizeof(bench_engines) / sizeof(bench_engines[0]))
+
+/* one measurement: best time over the runs and heap operations of a run */
+typedef struct {
+  double ns;
+  uint64_t pushes;
+  uint64_t pops;
+  uint64_t replaces;
+} bench_result_t;
+
+/*
+	times one engine; stops repeating once the runs took more than
+	`budget_ns` so the slow combinations (e.g. heap on ascending pixels
+	with a large X) don't stall the sweep. `prime`, if any, runs first
+	without being timed.
+*/
+static bench_result_t bench_engine(const image_t* image, uint32_t high_num,
+                                   bench_fn fn, bench_fn prime, uint32_t runs,
+                                   double budget_ns) {
+  bench_result_t result = {0, 0, 0, 0};
+  double spent = 0;
+  heap_t high_pixels;
+
+  if (init_heap(&high_pixels, high_num)) exit(1);
+
+  if (prime && prime(image, &high_pixels) < 0) exit(1);
+
+  for (uint32_t r = 0; r < runs && (!r || spent < budget_ns); ++r) {
+    high_pixels_stats_t stats;
+
+    high_pixels.size = 0;
+    high_pixels_stats_reset();
+
+    double start = now_ns();
+    fn(image, &high_pixels);
+    double elapsed = now_ns() - start;
+
+    spent += elapsed;
+
+    if (!r || elapsed < result.ns) result.ns = elapsed;
+
+    high_pixels_stats_get(&stats);
+    result.pushes = stats.pushes;
+    result.pops = stats.pops;
+    result.replaces = stats.replaces;
+  }
+
+  free_heap(&high_pixels);
+
+  return result;
+}
+
+/*
+	heap layouts: `ops` replace_top of random items on a full heap of
+	`capacity` items, SoA heap_t arrays or packed keys, with and without the
+	grandchildren prefetch. Returns the best ns per operation.
+*/
+static double bench_layout(uint32_t capacity, uint32_t ops, int8_t packed,
+                           int8_t prefetch, uint32_t runs) {
+  uint64_t* items = (uint64_t*)malloc((capacity + (size_t)ops) * sizeof(*items));
+  heap_t heap;
+  heap_key_t heap_key;
+  double best = 0;
+  rng_t rng;
+
+  if (!items || init_heap(&heap, capacity) || init_heap_key(&heap_key, capacity))
+    exit(1);
+
+  rng_seed(&rng, capacity);
+
+  for (uint32_t i = 0; i < capacity + ops; ++i)
+    items[i] = pixel_key((uint16_t)rng_next(&rng), i);
+
+  for (uint32_t r = 0; r < runs; ++r) {
+    for (uint32_t i = 0; i < capacity; ++i) {
+      heap.offsets[i] = pixel_key_offset(items[i]);
+      heap.values[i] = pixel_key_value(items[i]);
+      heap_key.keys[i] = items[i];
+    }
+
+    heap.size = heap_key.size = capacity;
+    heap_heapify(&heap);
+
+    for (uint32_t root = capacity >> 1; root-- > 0;)
+      heap_key_sift_down(heap_key.keys, capacity, root, heap_key.keys[root]);
+
+    const uint64_t* churn = items + capacity;
+    double start = now_ns();
+
+    if (packed)
+      for (uint32_t i = 0; i < ops; ++i)
+        heap_key_sift_down_with(heap_key.keys, capacity, 0, churn[i], prefetch);
+    else
+      for (uint32_t i = 0; i < ops; ++i)
+        heap_sift_down_with(heap.offsets, heap.values, capacity, 0,
+                            pixel_key_offset(churn[i]),
+                            pixel_key_value(churn[i]), prefetch);
+
+    double elapsed = (now_ns() - start) / ops;
+
+    if (!r || elapsed < best) best = elapsed;
+  }
+
+  free_heap_key(&heap_key);
+  free_heap(&heap);
+  free(items);
+
+  return best;
+}
+
+static void bench_layouts(uint32_t runs) {
+  static const uint32_t capacities[] = {1000, 10000, 100000, 1000000, 10000000};
+  static const char* names[] = {"soa", "soa_prefetch", "packed",
+                                "packed_prefetch"};
+
+  printf("layout\tcapacity\tns_per_op\n");
+
+  for (uint32_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c)
+    for (uint32_t l = 0; l < 4; ++l)
+      printf("%s\t%u\t%.2f\n", names[l], capacities[c],
+             bench_layout(capacities[c], 1 << 22, l >> 1, l & 1, runs));
+}
+
+/* `--name=value` option parsing */
+static const char* bench_option(const char* arg, const char* name) {
+  size_t len = strlen(name);
+
+  return !strncmp(arg, name, len) && arg[len] == '=' ? arg + len + 1 : NULL;
+}
+
+static void bench_usage(void) {
+  printf(
+      "usage: bench [options]\n"
+      "  --min-size=N   smallest square image side (default 64)\n"
+      "  --max-size=N   largest square image side (default 16384)\n"
+      "  --max-x=N      largest X (default 100000)\n"
+      "  --runs=N       runs per measurement, the best is kept (default 3)\n"
+      "  --budget=MS    stop repeating a measurement after MS (default 2000)\n"
+      "  --engine=NAME  only this engine (auto, heap, heap_scalar, heap_avx2,\n"
+      "                 select, histogram, packed, small, parallel, ...)\n"
+      "  --dist=NAME    only this distribution (uniform, uniform8,\n"
+      "                 ascending, descending, constant, heavy_tail)\n"
+      "  --layout       heap layouts replace_top churn instead of the sweep\n"
+      "Prints one tab separated line per engine/distribution/size/X.\n");
+}
+
+/*
+	sweeps square images from 64x64 to 16Kx16K, X from 1 to 100k, all the
+	pixel distributions and engines.
+*/
+int main(int argc, char** argv) {
+  static const uint32_t counts[] = {1,   4,    8,     10,    16,
+                                    50,  100,  1000,  10000, 100000};
+  uint32_t min_size = 64, max_size = 16384, max_x = 100000, runs = 3;
+  double budget_ns = 2000 * 1e6;
+  const char* engine = NULL;
+  const char* dist = NULL;
+  int8_t layout = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* v;
+
+    if ((v = bench_option(argv[i], "--min-size")))
+      min_size = (uint32_t)atoi(v);
+    else if ((v = bench_option(argv[i], "--max-size")))
+      max_size = (uint32_t)atoi(v);
+    else if ((v = bench_option(argv[i], "--max-x")))
+      max_x = (uint32_t)atoi(v);
+    else if ((v = bench_option(argv[i], "--runs")))
+      runs = (uint32_t)atoi(v);
+    else if ((v = bench_option(argv[i], "--budget")))
+      budget_ns = atof(v) * 1e6;
+    else if ((v = bench_option(argv[i], "--engine")))
+      engine = v;
+    else if ((v = bench_option(argv[i], "--dist")))
+      dist = v;
+    else if (!strcmp(argv[i], "--layout"))
+      layout = 1;
+    else {
+      bench_usage();
+      return strcmp(argv[i], "--help") ? 1 : 0;
+    }
+  }
+
+  if (layout) {
+    bench_layouts(runs);
+    return 0;
+  }
+
+  if (max_size > UINT16_MAX) max_size = UINT16_MAX;
+
+  printf(
+      "engine\tdist\tsize_x\tsize_y\tx\tns_per_pixel\tgb_per_s\tpushes\t"
+      "pops\treplaces\n");
+
+  for (uint32_t side = min_size; side && side <= max_size; side *= 4) {
+    image_t image;
+
+    if (init_image(&image, (uint16_t)side, (uint16_t)side)) exit(1);
+
+    uint32_t size = (uint32_t)image.size_x * image.size_y;
+
+    for (dist_t d = DIST_UNIFORM; d < DIST_COUNT; ++d) {
+      if (dist && strcmp(dist, dist_names[d])) continue;
+
+      fill_image(&image, d, 0x9e3779b9, 0);
+
+      for (uint32_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        if (counts[c] > size || counts[c] > max_x) continue;
+
+        for (uint32_t e = 0; e < BENCH_ENGINES; ++e) {
+          if (engine && strcmp(engine, bench_engines[e].name)) continue;
+
+          bench_result_t r =
+              bench_engine(&image, counts[c], bench_engines[e].fn,
+                           bench_engines[e].prime, runs, budget_ns);
+
+          printf("%s\t%s\t%hu\t%hu\t%u\t%.4f\t%.3f\t%llu\t%llu\t%llu\n",
+                 bench_engines[e].name, dist_names[d], image.size_x,
+                 image.size_y, counts[c], r.ns / size,
+                 size * sizeof(*image.pixels) / r.ns,
+                 (unsigned long long)r.pushes, (unsigned long long)r.pops,
+                 (unsigned long long)r.replaces);
+          fflush(stdout);
+        }
+      }
+    }
+
+    free_image(&image);
+  }
+
+  return 0;
+}
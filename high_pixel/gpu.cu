@@ -0,0 +1,343 @@
+/*
+	CUDA backend: top X pixels of a 16-bit frame already in device memory,
+	see build_high_pixels_gpu() in highpixel.c.
+
+	Same radix idea as the histogram engine: a histogram of the high bytes
+	gives the bin holding the X-th highest pixel, a histogram of the low
+	bytes within that bin gives its exact value t. Then the pixels above t,
+	less than X of them, are gathered in any order, and the pixels equal to
+	t are gathered in offset order, only the lowest offsets needed to reach
+	X, so the result matches the CPU engines tie rule. Only the X (offset,
+	value) pairs travel back to the host.
+*/
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define GPU_THREADS 256
+#define GPU_ITEMS 16                         /* contiguous pixels per thread */
+#define GPU_TILE (GPU_THREADS * GPU_ITEMS)   /* pixels per block */
+#define GPU_BINS 256
+#define GPU_WARPS (GPU_THREADS / 32)
+
+/*
+	histogram of the high bytes or, when `high` >= 0, of the low bytes of
+	the pixels whose high byte is `high`; block histograms in shared memory
+	are added to the global one.
+*/
+__global__ static void histogram_kernel(const uint16_t* pixels, uint32_t count,
+                                        int32_t high, uint32_t* bins) {
+  __shared__ uint32_t local[GPU_BINS];
+
+  for (uint32_t i = threadIdx.x; i < GPU_BINS; i += blockDim.x) local[i] = 0;
+
+  __syncthreads();
+
+  for (uint32_t i = blockIdx.x * blockDim.x + threadIdx.x; i < count;
+       i += gridDim.x * blockDim.x) {
+    uint16_t v = pixels[i];
+
+    if (high < 0)
+      atomicAdd(&local[v >> 8], 1u);
+    else if ((v >> 8) == high)
+      atomicAdd(&local[v & 0xff], 1u);
+  }
+
+  __syncthreads();
+
+  for (uint32_t i = threadIdx.x; i < GPU_BINS; i += blockDim.x)
+    if (local[i]) atomicAdd(&bins[i], local[i]);
+}
+
+/* the pixels above the threshold, less than X of them, in any order */
+__global__ static void gather_above_kernel(const uint16_t* pixels,
+                                           uint32_t count, uint16_t threshold,
+                                           uint32_t* offsets, uint16_t* values,
+                                           uint32_t* cursor) {
+  for (uint32_t i = blockIdx.x * blockDim.x + threadIdx.x; i < count;
+       i += gridDim.x * blockDim.x) {
+    uint16_t v = pixels[i];
+
+    if (v > threshold) {
+      uint32_t k = atomicAdd(cursor, 1u);
+
+      offsets[k] = i;
+      values[k] = v;
+    }
+  }
+}
+
+/* pixels equal to the threshold among the GPU_ITEMS of the thread */
+__device__ static uint32_t count_equal(const uint16_t* pixels, uint32_t count,
+                                       uint16_t threshold, uint32_t start) {
+  uint32_t equal = 0;
+
+  for (uint32_t i = start; i < start + GPU_ITEMS && i < count; ++i)
+    equal += pixels[i] == threshold;
+
+  return equal;
+}
+
+/* exclusive prefix sum over the block threads, in thread order */
+__device__ static uint32_t block_exclusive_scan(uint32_t v) {
+  __shared__ uint32_t warps[GPU_WARPS];
+  uint32_t lane = threadIdx.x & 31, warp = threadIdx.x >> 5;
+  uint32_t x = v;
+
+  for (uint32_t o = 1; o < 32; o <<= 1) {
+    uint32_t y = __shfl_up_sync(0xffffffffu, x, o);
+
+    if (lane >= o) x += y;
+  }
+
+  if (lane == 31) warps[warp] = x;
+
+  __syncthreads();
+
+  if (warp == 0) {
+    uint32_t w = lane < GPU_WARPS ? warps[lane] : 0;
+
+    for (uint32_t o = 1; o < GPU_WARPS; o <<= 1) {
+      uint32_t y = __shfl_up_sync(0xffffffffu, w, o);
+
+      if (lane >= o) w += y;
+    }
+
+    if (lane < GPU_WARPS) warps[lane] = w;
+  }
+
+  __syncthreads();
+
+  return x - v + (warp ? warps[warp - 1] : 0);
+}
+
+/* pixels equal to the threshold per tile of GPU_TILE pixels */
+__global__ static void count_equal_kernel(const uint16_t* pixels,
+                                          uint32_t count, uint16_t threshold,
+                                          uint32_t* tile_counts) {
+  __shared__ uint32_t total;
+  uint32_t start = blockIdx.x * GPU_TILE + threadIdx.x * GPU_ITEMS;
+
+  if (!threadIdx.x) total = 0;
+
+  __syncthreads();
+
+  uint32_t equal = count_equal(pixels, count, threshold, start);
+
+  if (equal) atomicAdd(&total, equal);
+
+  __syncthreads();
+
+  if (!threadIdx.x) tile_counts[blockIdx.x] = total;
+}
+
+/*
+	the pixels equal to the threshold with rank < `need` in offset order:
+	the tile prefix plus the rank within the tile.
+*/
+__global__ static void gather_equal_kernel(const uint16_t* pixels,
+                                           uint32_t count, uint16_t threshold,
+                                           const uint32_t* tile_prefix,
+                                           uint32_t need, uint32_t* offsets,
+                                           uint16_t* values) {
+  uint32_t prefix = tile_prefix[blockIdx.x];
+
+  /* block uniform, no thread is left behind a barrier */
+  if (prefix >= need) return;
+
+  uint32_t start = blockIdx.x * GPU_TILE + threadIdx.x * GPU_ITEMS;
+  uint32_t rank =
+      prefix +
+      block_exclusive_scan(count_equal(pixels, count, threshold, start));
+
+  for (uint32_t i = start; i < start + GPU_ITEMS && i < count && rank < need;
+       ++i)
+    if (pixels[i] == threshold) {
+      offsets[rank] = i;
+      values[rank] = threshold;
+      ++rank;
+    }
+}
+
+/* the bin where the running count from the top reaches `need` */
+static uint32_t bins_find(const uint32_t* bins, uint32_t need,
+                          uint32_t* above) {
+  uint32_t bin = GPU_BINS - 1;
+
+  *above = 0;
+
+  for (; bin > 0 && *above + bins[bin] < need; --bin) *above += bins[bin];
+
+  return bin;
+}
+
+/* device scratch: bins, gather cursor, then the tiles counts */
+struct gpu_scratch {
+  uint32_t* bins;
+  uint32_t* cursor;
+  uint32_t* tiles;
+  uint32_t* offsets;
+  uint16_t* values;
+  uint32_t* prefix; /* host side tiles prefix */
+};
+
+static void gpu_scratch_free(gpu_scratch* scratch) {
+  cudaFree(scratch->bins);
+  cudaFree(scratch->offsets);
+  cudaFree(scratch->values);
+  free(scratch->prefix);
+}
+
+/*
+	fails on the first CUDA error; a launch error surfaces right away from
+	cudaGetLastError(), an execution error from the next synchronous copy.
+*/
+#define GPU_CHECK(call)                   \
+  do {                                    \
+    if ((call) != cudaSuccess) return -1; \
+  } while (0)
+
+#define GPU_LAUNCHED() GPU_CHECK(cudaGetLastError())
+
+/*
+	the selection passes on allocated scratch, the caller frees it.
+
+	return negative value on failure, >= 0 otherwise
+*/
+static int32_t gpu_select(const uint16_t* pixels, uint32_t count,
+                          uint32_t need, uint32_t blocks, uint32_t tiles,
+                          gpu_scratch* scratch, uint32_t* offsets,
+                          uint16_t* values) {
+  uint32_t host_bins[GPU_BINS];
+
+  /* high byte bin of the X-th pixel */
+  uint32_t above, high, low;
+
+  GPU_CHECK(cudaMemset(scratch->bins, 0, (GPU_BINS + 1) * sizeof(uint32_t)));
+  histogram_kernel<<<blocks, GPU_THREADS>>>(pixels, count, -1, scratch->bins);
+  GPU_LAUNCHED();
+  GPU_CHECK(cudaMemcpy(host_bins, scratch->bins, sizeof(host_bins),
+                       cudaMemcpyDeviceToHost));
+
+  high = bins_find(host_bins, need, &above);
+
+  /* low byte within that bin */
+  uint32_t above_fine;
+
+  GPU_CHECK(cudaMemset(scratch->bins, 0, GPU_BINS * sizeof(uint32_t)));
+  histogram_kernel<<<blocks, GPU_THREADS>>>(pixels, count, (int32_t)high,
+                                             scratch->bins);
+  GPU_LAUNCHED();
+  GPU_CHECK(cudaMemcpy(host_bins, scratch->bins, sizeof(host_bins),
+                       cudaMemcpyDeviceToHost));
+
+  low = bins_find(host_bins, need - above, &above_fine);
+  above += above_fine;
+
+  uint16_t threshold = (uint16_t)(high << 8 | low);
+
+  /* the pixels above the threshold, then the lowest offsets equal to it */
+  gather_above_kernel<<<blocks, GPU_THREADS>>>(
+      pixels, count, threshold, scratch->offsets, scratch->values,
+      scratch->cursor);
+  GPU_LAUNCHED();
+
+  count_equal_kernel<<<tiles, GPU_THREADS>>>(pixels, count, threshold,
+                                              scratch->tiles);
+  GPU_LAUNCHED();
+
+  uint32_t* prefix = scratch->prefix;
+
+  GPU_CHECK(cudaMemcpy(prefix, scratch->tiles, tiles * sizeof(uint32_t),
+                       cudaMemcpyDeviceToHost));
+
+  for (uint32_t i = 0, sum = 0; i < tiles; ++i) {
+    uint32_t tile = prefix[i];
+
+    prefix[i] = sum;
+    sum += tile;
+  }
+
+  GPU_CHECK(cudaMemcpy(scratch->tiles + tiles, prefix,
+                       tiles * sizeof(uint32_t), cudaMemcpyHostToDevice));
+
+  gather_equal_kernel<<<tiles, GPU_THREADS>>>(
+      pixels, count, threshold, scratch->tiles + tiles, need - above,
+      scratch->offsets + above, scratch->values + above);
+  GPU_LAUNCHED();
+
+  GPU_CHECK(cudaMemcpy(offsets, scratch->offsets, need * sizeof(uint32_t),
+                       cudaMemcpyDeviceToHost));
+  GPU_CHECK(cudaMemcpy(values, scratch->values, need * sizeof(uint16_t),
+                       cudaMemcpyDeviceToHost));
+
+  return 0;
+}
+
+/*
+	top `high_num` pixels of `count` device pixels into the host arrays
+	`offsets` and `values`, `*size` receiving the number of pairs.
+
+	return negative value on failure, >= 0 otherwise
+*/
+extern "C" int32_t gpu_high_pixels(const uint16_t* pixels, uint32_t count,
+                                   uint32_t high_num, uint32_t* offsets,
+                                   uint16_t* values, uint32_t* size) {
+  uint32_t need = count < high_num ? count : high_num;
+  uint32_t tiles = (count + GPU_TILE - 1) / GPU_TILE;
+  gpu_scratch scratch = {NULL, NULL, NULL, NULL, NULL, NULL};
+  int device, sms;
+
+  *size = 0;
+
+  if (!need) return 0;
+
+  if (cudaGetDevice(&device) != cudaSuccess ||
+      cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device) !=
+          cudaSuccess)
+    return -1;
+
+  /* grid-stride kernels: a few blocks per multiprocessor */
+  uint32_t blocks = (count + GPU_THREADS - 1) / GPU_THREADS;
+
+  if (blocks > (uint32_t)sms * 8) blocks = sms * 8;
+
+  if (cudaMalloc(&scratch.bins, (GPU_BINS + 1 + 2 * tiles) * sizeof(uint32_t)) !=
+          cudaSuccess ||
+      cudaMalloc(&scratch.offsets, need * sizeof(uint32_t)) != cudaSuccess ||
+      cudaMalloc(&scratch.values, need * sizeof(uint16_t)) != cudaSuccess ||
+      !(scratch.prefix = (uint32_t*)malloc(tiles * sizeof(uint32_t)))) {
+    gpu_scratch_free(&scratch);
+    return -1;
+  }
+
+  scratch.cursor = scratch.bins + GPU_BINS;
+  scratch.tiles = scratch.cursor + 1;
+
+  int32_t err = gpu_select(pixels, count, need, blocks, tiles, &scratch,
+                           offsets, values);
+
+  gpu_scratch_free(&scratch);
+
+  if (err < 0) return err;
+
+  *size = need;
+
+  return 0;
+}
+
+/* test helpers: copies host pixels to the device and releases them */
+extern "C" int32_t gpu_upload_pixels(const uint16_t* pixels, uint32_t count,
+                                     uint16_t** device) {
+  if (cudaMalloc(device, count * sizeof(uint16_t)) != cudaSuccess) return -1;
+
+  if (cudaMemcpy(*device, pixels, count * sizeof(uint16_t),
+                 cudaMemcpyHostToDevice) != cudaSuccess) {
+    cudaFree(*device);
+    return -1;
+  }
+
+  return 0;
+}
+
+extern "C" void gpu_free_pixels(uint16_t* device) { cudaFree(device); }
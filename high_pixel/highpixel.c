@@ -0,0 +1,4784 @@
+#define _GNU_SOURCE /* pthread_setaffinity_np() */
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "highpixel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL 1
+#endif
+
+/*
+   Problem: get top 50 high value pixels from an image with N pixels, where
+   N = row x columns.
+
+   Assumptions:
+        (1) the image is provided as contiguous block of 16-bit values
+        (2) the image pixel count is less than 65536 * 65536
+        (3) all index are zero based
+
+   Chosen solution: use a min heap to hold the highest X values and their
+   positions (offset within the block). The algorithm is implemented in
+   build_high_pixels() function.
+
+   Runtime: O(N + X * log (X))
+   Memory space: O(2 * X), the `2` comes from the fact that we store both
+   pixels values + pixel positions
+
+   For large X the heap sift-downs dominate so a selection based engine is
+   used instead: candidates are appended to a buffer which is partitioned
+   (nth_element style) every time it fills up.
+   Runtime: O(N + X) on average; memory space: O(2 * X) 64-bit keys.
+
+   Since pixels are 16-bit, the histogram engine finds the exact X-th value
+   with a coarse and a fine 256-bin histogram pass and collects the pixels
+   above it in a third pass, no heap operation at all.
+   Runtime: O(3 * N + X); memory space: O(5 * 256) counters.
+
+   Ties: pixels with the same value are ranked by their offset, the lower
+   offset wins. This makes the selected set unique so all the engines
+   (serial or parallel) produce the same result.
+*/
+
+#define SWAP(a, b, t) (((t) = (a), (a) = (b), (b) = (t)))
+
+/* the benchmark reports the heap operations */
+#if defined(HIGH_PIXEL_BENCH) && !defined(HIGH_PIXEL_STATS)
+#define HIGH_PIXEL_STATS
+#endif
+
+#ifdef HIGH_PIXEL_STATS
+static _Thread_local high_pixels_stats_t stats_local;
+static high_pixels_stats_t stats_total;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t stats_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* levels moved by a sift down from `from` to `to` */
+static inline void stats_sift(uint32_t from, uint32_t to) {
+  uint32_t depth = __builtin_clz(from + 1) - __builtin_clz(to + 1);
+
+  ++stats_local.sift_depth[depth < STATS_SIFT_DEPTHS ? depth
+                                                     : STATS_SIFT_DEPTHS - 1];
+}
+
+#define STATS_ADD(counter, n) (stats_local.counter += (n))
+#define STATS_SIFT(from, to) stats_sift((from), (to))
+#define STATS_START(start) uint64_t start = stats_now()
+#define STATS_PHASE(phase, start) (stats_local.ns[phase] += stats_now() - (start))
+#else
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_SIFT(from, to) ((void)0)
+#define STATS_START(start) ((void)0)
+#define STATS_PHASE(phase, start) ((void)0)
+#endif
+
+/* adds the calling thread counters to the totals and resets them */
+void high_pixels_stats_flush(void) {
+#ifdef HIGH_PIXEL_STATS
+  uint64_t* local = (uint64_t*)&stats_local;
+  uint64_t* total = (uint64_t*)&stats_total;
+
+  pthread_mutex_lock(&stats_lock);
+
+  for (size_t i = 0; i < sizeof(stats_local) / sizeof(*local); ++i)
+    total[i] += local[i];
+
+  pthread_mutex_unlock(&stats_lock);
+
+  memset(&stats_local, 0, sizeof(stats_local));
+#endif
+}
+
+/*
+	reads the totals, the calling thread counters flushed first; all zeroes
+	when the stats are compiled out.
+*/
+void high_pixels_stats_get(high_pixels_stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+#ifdef HIGH_PIXEL_STATS
+  high_pixels_stats_flush();
+
+  pthread_mutex_lock(&stats_lock);
+  *stats = stats_total;
+  pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+/* resets the totals and the calling thread counters */
+void high_pixels_stats_reset(void) {
+#ifdef HIGH_PIXEL_STATS
+  memset(&stats_local, 0, sizeof(stats_local));
+
+  pthread_mutex_lock(&stats_lock);
+  memset(&stats_total, 0, sizeof(stats_total));
+  pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+/*
+	Initialize an arena for `frames` heaps of the provided capacity.
+
+	return 0 on success, != 0 otherwise
+*/
+int32_t init_heap_arena(heap_arena_t* arena, uint32_t frames,
+                        uint32_t capacity) {
+  if (!arena || !frames) return -1;
+
+  uint64_t items = (uint64_t)frames * capacity;
+  uint64_t bytes = frames * sizeof(heap_t) +
+                   items * (sizeof(*arena->heaps->offsets) +
+                            sizeof(*arena->heaps->values));
+
+  if (bytes > SIZE_MAX) return -1;
+
+  arena->heaps = (heap_t*)malloc((size_t)bytes);
+
+  if (!arena->heaps) return -1;
+
+  uint32_t* offsets = (uint32_t*)(arena->heaps + frames);
+  uint16_t* values = (uint16_t*)(offsets + items);
+
+  for (uint32_t i = 0; i < frames; ++i) {
+    arena->heaps[i].capacity = capacity;
+    arena->heaps[i].size = 0;
+    arena->heaps[i].offsets = offsets + (uint64_t)i * capacity;
+    arena->heaps[i].values = values + (uint64_t)i * capacity;
+  }
+
+  arena->frames = frames;
+  arena->capacity = capacity;
+
+  return 0;
+}
+
+/*
+	Deallocates arena resources; the arena heaps must not be released with
+	free_heap().
+*/
+void free_heap_arena(heap_arena_t* arena) {
+  if (!arena || !arena->heaps) return;
+
+  free(arena->heaps);
+  arena->heaps = NULL;
+}
+
+/* worker routine, `worker` is the worker index in [0, threads) */
+typedef void (*worker_fn)(void* arg, uint32_t worker);
+
+typedef struct {
+  worker_fn fn;
+  void* arg;
+  uint32_t worker;
+} worker_t;
+
+static void* worker_main(void* arg) {
+  worker_t* worker = (worker_t*)arg;
+
+  worker->fn(worker->arg, worker->worker);
+
+  if (worker->worker) high_pixels_stats_flush();
+
+  return NULL;
+}
+
+/*
+	resolves the workers count for `jobs` independent jobs, 0 threads meaning
+	one worker per online CPU.
+*/
+static uint32_t workers_count(uint32_t threads, uint32_t jobs) {
+  if (!threads) threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > jobs) threads = jobs;
+
+  return threads ? threads : 1;
+}
+
+/*
+	Worker pool: threads spawned once and parked between jobs, so a parallel
+	call only pays a wake up. Worker 0 is always the calling thread, the pool
+	threads are workers 1 and up, each one pinned to a CPU of the process
+	affinity set so the frame slices it first touched stay on its NUMA node
+	(see slices_take()). The pool runs one job at a time and owns the scratch
+	heaps of the parallel scans; a job submitted while it is busy, from
+	another thread or from a pool worker, falls back to threads of its own.
+*/
+#define POOL_WORKERS 256 /* pool workers, the caller included */
+
+typedef struct {
+  pthread_t tid;
+  uint32_t worker;
+  uint64_t seen; /* last job generation handled */
+} pool_thread_t;
+
+typedef struct {
+  pthread_mutex_t job;   /* held by the caller for the whole job */
+  pthread_mutex_t state; /* guards the fields below */
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  pool_thread_t threads[POOL_WORKERS - 1];
+  uint32_t count;      /* pool threads, workers 1 to count */
+  uint32_t active;     /* workers of the current job, caller included */
+  uint32_t pending;    /* pool threads still running the current job */
+  uint64_t generation; /* current job */
+  int8_t stop;
+  worker_fn fn;
+  void* arg;
+  heap_arena_t scratch; /* see pool_scratch() */
+} pool_t;
+
+static pool_t pool = {.job = PTHREAD_MUTEX_INITIALIZER,
+                      .state = PTHREAD_MUTEX_INITIALIZER,
+                      .wake = PTHREAD_COND_INITIALIZER,
+                      .done = PTHREAD_COND_INITIALIZER};
+
+/* pins the calling thread to the n-th CPU of the process affinity set */
+static void pool_pin(uint32_t n) {
+#ifdef __linux__
+  cpu_set_t allowed, cpu;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed)) return;
+
+  uint32_t cpus = (uint32_t)CPU_COUNT(&allowed);
+
+  if (!cpus) return;
+
+  n %= cpus;
+
+  for (uint32_t i = 0; i < CPU_SETSIZE; ++i)
+    if (CPU_ISSET(i, &allowed) && !n--) {
+      CPU_ZERO(&cpu);
+      CPU_SET(i, &cpu);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu);
+      return;
+    }
+#else
+  (void)n;
+#endif
+}
+
+static void* pool_main(void* arg) {
+  pool_thread_t* thread = (pool_thread_t*)arg;
+  uint32_t worker = thread->worker;
+
+  pool_pin(worker);
+
+  pthread_mutex_lock(&pool.state);
+
+  for (;;) {
+    while (!pool.stop && pool.generation == thread->seen)
+      pthread_cond_wait(&pool.wake, &pool.state);
+
+    if (pool.stop) break;
+
+    thread->seen = pool.generation;
+
+    if (worker >= pool.active) continue;
+
+    worker_fn fn = pool.fn;
+    void* job = pool.arg;
+
+    pthread_mutex_unlock(&pool.state);
+
+    fn(job, worker);
+    high_pixels_stats_flush();
+
+    pthread_mutex_lock(&pool.state);
+
+    if (!--pool.pending) pthread_cond_signal(&pool.done);
+  }
+
+  pthread_mutex_unlock(&pool.state);
+
+  return NULL;
+}
+
+/*
+	takes the pool for a job; the pool threads are spawned up to `threads`
+	workers. Returns 0 when the pool is busy.
+*/
+static int8_t pool_acquire(uint32_t threads) {
+  if (pthread_mutex_trylock(&pool.job)) return 0;
+
+  if (threads > POOL_WORKERS) threads = POOL_WORKERS;
+
+  for (; pool.count < threads - 1; ++pool.count) {
+    pool_thread_t* thread = &pool.threads[pool.count];
+
+    thread->worker = pool.count + 1;
+    thread->seen = pool.generation;
+
+    if (pthread_create(&thread->tid, NULL, pool_main, thread)) break;
+  }
+
+  return 1;
+}
+
+static void pool_release(void) { pthread_mutex_unlock(&pool.job); }
+
+/*
+	runs a job on the acquired pool; workers the pool couldn't spawn are
+	missing, their work is left to the running ones.
+*/
+static void pool_run(uint32_t threads, worker_fn fn, void* arg) {
+  pthread_mutex_lock(&pool.state);
+
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.active = threads < pool.count + 1 ? threads : pool.count + 1;
+  pool.pending = pool.active - 1;
+  ++pool.generation;
+
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.state);
+
+  fn(arg, 0);
+
+  pthread_mutex_lock(&pool.state);
+
+  while (pool.pending) pthread_cond_wait(&pool.done, &pool.state);
+
+  pthread_mutex_unlock(&pool.state);
+}
+
+/*
+	scratch arena of the acquired pool holding `heaps` empty heaps of the
+	provided capacity; it only grows, so steady state calls don't allocate.
+
+	return NULL on failure
+*/
+static heap_arena_t* pool_scratch(uint32_t heaps, uint32_t capacity) {
+  heap_arena_t* scratch = &pool.scratch;
+
+  if (!scratch->heaps || scratch->frames < heaps ||
+      scratch->capacity < capacity) {
+    uint32_t frames = scratch->heaps && scratch->frames > heaps
+                          ? scratch->frames
+                          : heaps;
+
+    if (scratch->heaps && scratch->capacity > capacity)
+      capacity = scratch->capacity;
+
+    free_heap_arena(scratch);
+
+    if (init_heap_arena(scratch, frames, capacity)) return NULL;
+  }
+
+  return scratch;
+}
+
+/*
+	spawns the pool threads for `threads` workers ahead of the first job, 0
+	meaning one worker per online CPU; the pool otherwise grows on demand.
+
+	return negative value on failure, 0 otherwise
+*/
+int32_t high_pixels_pool_start(uint32_t threads) {
+  threads = workers_count(threads, POOL_WORKERS);
+
+  if (!pool_acquire(threads)) return -1;
+
+  int32_t err = pool.count + 1 < threads ? -1 : 0;
+
+  pool_release();
+
+  return err;
+}
+
+/* joins the pool threads and releases the scratch heaps */
+void high_pixels_pool_stop(void) {
+  pthread_mutex_lock(&pool.job);
+  pthread_mutex_lock(&pool.state);
+
+  pool.stop = 1;
+
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.state);
+
+  for (uint32_t i = 0; i < pool.count; ++i)
+    pthread_join(pool.threads[i].tid, NULL);
+
+  free_heap_arena(&pool.scratch);
+
+  pool.count = 0;
+  pool.stop = 0;
+
+  pthread_mutex_unlock(&pool.job);
+}
+
+/*
+	runs `fn` on `threads` workers, the calling thread being worker 0, and
+	waits for all of them. If a thread can't be created the work is left to
+	the running workers so the routines must share the jobs dynamically.
+
+	return negative value on failure, 0 otherwise
+*/
+static int32_t run_workers(uint32_t threads, worker_fn fn, void* arg) {
+  if (threads == 1) {
+    fn(arg, 0);
+    return 0;
+  }
+
+  if (pool_acquire(threads)) {
+    pool_run(threads, fn, arg);
+    pool_release();
+    return 0;
+  }
+
+  /* the pool is busy: threads for this call only */
+  worker_t* workers = (worker_t*)calloc(threads, sizeof(*workers));
+  pthread_t* tids = (pthread_t*)calloc(threads, sizeof(*tids));
+  uint32_t started = 1;
+
+  if (!workers || !tids) {
+    free(tids);
+    free(workers);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < threads; ++i) {
+    workers[i].fn = fn;
+    workers[i].arg = arg;
+    workers[i].worker = i;
+  }
+
+  for (; started < threads; ++started)
+    if (pthread_create(&tids[started], NULL, worker_main, &workers[started]))
+      break;
+
+  worker_main(&workers[0]);
+
+  for (uint32_t i = 1; i < started; ++i) pthread_join(tids[i], NULL);
+
+  free(tids);
+  free(workers);
+
+  return 0;
+}
+
+/*
+	Work stealing over ordered jobs: the jobs are split in one contiguous
+	slice per worker. A worker takes the jobs of its own slice in order, then
+	steals from the front of the next slices, wrapping around to the first
+	ones, so a slow slice (saturated regions churn the heaps) is drained by
+	every worker that is done with its own. The jobs of the slices from the
+	worker's own up to the last, and those of the slices before it, form two
+	increasing sequences: keeping one heap per sequence preserves the in
+	order offsets the scan kernels rely on.
+
+	The frame slices match the workers slices of fill_image(), so with
+	pinned pool workers and the same workers count a worker scans the pages
+	it first touched, which the kernel placed on its NUMA node.
+*/
+typedef struct {
+  _Alignas(64) atomic_uint next; /* next job of the slice */
+  uint32_t end;                  /* slice end */
+} slice_t;
+
+/* `workers` slices over `jobs` jobs, NULL on failure */
+static slice_t* slices_init(uint32_t workers, uint32_t jobs) {
+  slice_t* slices = (slice_t*)aligned_alloc(_Alignof(slice_t),
+                                            workers * sizeof(*slices));
+
+  if (!slices) return NULL;
+
+  for (uint32_t i = 0; i < workers; ++i) {
+    atomic_init(&slices[i].next, (uint32_t)((uint64_t)jobs * i / workers));
+    slices[i].end = (uint32_t)((uint64_t)jobs * (i + 1) / workers);
+  }
+
+  return slices;
+}
+
+/*
+	next job of `worker`, `*victim` being the slice it is taking from,
+	initially the worker one; UINT32_MAX when all the slices are drained.
+*/
+static uint32_t slices_take(slice_t* slices, uint32_t workers,
+                            uint32_t worker, uint32_t* victim) {
+  do {
+    slice_t* slice = &slices[*victim];
+
+    if (atomic_load_explicit(&slice->next, memory_order_relaxed) < slice->end) {
+      uint32_t job = atomic_fetch_add(&slice->next, 1);
+
+      if (job < slice->end) return job;
+    }
+
+    *victim = *victim + 1 < workers ? *victim + 1 : 0;
+  } while (*victim != worker);
+
+  return UINT32_MAX;
+}
+
+/* check image validity */
+static inline int8_t image_check_valid(const image_t* image) {
+  return image && image->pixels;
+}
+
+/*
+	Random generator: xoshiro256**, seeded with splitmix64 so that any
+	64-bit seed, including 0, gives a well mixed state.
+*/
+typedef struct {
+  uint64_t s[4];
+} rng_t;
+
+static inline uint64_t splitmix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+static void rng_seed(rng_t* rng, uint64_t seed) {
+  for (uint32_t i = 0; i < 4; ++i) rng->s[i] = splitmix64(&seed);
+}
+
+static inline uint64_t rotl64(uint64_t x, uint32_t k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(rng_t* rng) {
+  uint64_t* s = rng->s;
+  uint64_t result = rotl64(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl64(s[3], 45);
+
+  return result;
+}
+
+/* pixels per generator block; each block has its own generator */
+#define FILL_BLOCK (64 * 1024)
+
+typedef struct {
+  image_t* image;
+  dist_t dist;
+  uint64_t seed;
+  uint32_t blocks;
+  uint32_t workers;
+  slice_t* slices; /* blocks of every worker, see slices_take() */
+} fill_t;
+
+/*
+	fills one block; ascending and descending ramps only depend on the
+	offset, the other distributions draw 4 pixels per generator output.
+*/
+static void fill_block(const fill_t* fill, uint32_t block) {
+  uint32_t size = (uint32_t)fill->image->size_x * fill->image->size_y;
+  uint32_t start = block * FILL_BLOCK;
+  uint32_t end = size - start < FILL_BLOCK ? size : start + FILL_BLOCK;
+  uint16_t* pixels = fill->image->pixels;
+  double last = size > 1 ? size - 1 : 1;
+  rng_t rng;
+
+  /* the block generator only depends on the seed and the block index */
+  rng_seed(&rng, fill->seed ^ splitmix64(&(uint64_t){block}));
+
+  switch (fill->dist) {
+    case DIST_ASCENDING:
+      for (uint32_t i = start; i < end; ++i)
+        pixels[i] = (uint16_t)(i / last * UINT16_MAX);
+      return;
+    case DIST_DESCENDING:
+      for (uint32_t i = start; i < end; ++i)
+        pixels[i] = (uint16_t)((size - 1 - i) / last * UINT16_MAX);
+      return;
+    default:
+      break;
+  }
+
+  for (uint32_t i = start; i < end; i += 4) {
+    uint64_t r = rng_next(&rng);
+
+    for (uint32_t j = i; j < end && j < i + 4; ++j, r >>= 16) {
+      uint16_t v = (uint16_t)r;
+
+      switch (fill->dist) {
+        case DIST_UNIFORM8:
+          v &= 0xff;
+          break;
+        case DIST_CONSTANT:
+          v = (v & 0x3f) ? 0x1000 : v;
+          break;
+        case DIST_HEAVY_TAIL: {
+          /* inverse CDF of a Pareto distribution with alpha = 1.5 */
+          float p = 64.0f / powf((v + 1) / 65536.0f, 1 / 1.5f);
+          v = p > UINT16_MAX ? UINT16_MAX : (uint16_t)p;
+          break;
+        }
+        default:
+          break;
+      }
+
+      pixels[j] = v;
+    }
+  }
+}
+
+static void fill_worker(void* arg, uint32_t worker) {
+  fill_t* fill = (fill_t*)arg;
+  uint32_t victim = worker;
+
+  uint32_t block;
+
+  while ((block = slices_take(fill->slices, fill->workers, worker, &victim)) !=
+         UINT32_MAX)
+    fill_block(fill, block);
+}
+
+/*
+	Fills the image with the provided distribution using `threads` workers,
+	0 meaning one worker per online CPU. The content only depends on the
+	seed, not on the workers count. Each worker first touches its own slice
+	of the frame, the one it scans in the parallel engines. Pixels borrowed
+	from a file mapping are read only, such images are rejected.
+
+	returns negative value on fail, 0 otherwise
+*/
+int32_t fill_image(image_t* image, dist_t dist, uint64_t seed,
+                   uint32_t threads) {
+  if (!image_check_valid(image) || image->map_base || dist >= DIST_COUNT)
+    return -1;
+
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  fill_t fill;
+
+  fill.image = image;
+  fill.dist = dist;
+  fill.seed = seed;
+  fill.blocks = (size + FILL_BLOCK - 1) / FILL_BLOCK;
+
+  if (!fill.blocks) return 0;
+
+  fill.workers = workers_count(threads, fill.blocks);
+  fill.slices = slices_init(fill.workers, fill.blocks);
+
+  if (!fill.slices) return -1;
+
+  int32_t err = run_workers(fill.workers, fill_worker, &fill);
+
+  free(fill.slices);
+
+  return err;
+}
+
+/*
+	Initialize image with the provided distribution and seed
+    returns negative value on fail, 0 otherwise
+*/
+int32_t init_image_ex(image_t* image, uint16_t x, uint16_t y, dist_t dist,
+                      uint64_t seed) {
+  if (!image || !x || !y) return -1;
+
+  uint32_t size = (uint32_t)x * y;
+
+  image->pixels = (uint16_t*)malloc(size * sizeof(*image->pixels));
+
+  if (!image->pixels) return -1;
+
+  image->size_x = x;
+  image->size_y = y;
+  image->borrowed = 0;
+  image->map_base = NULL;
+  image->map_length = 0;
+
+  if (fill_image(image, dist, seed, 0)) {
+    free(image->pixels);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* seed of the next init_image() image */
+static atomic_ullong image_seed;
+
+/*
+	Initialize image with random 16-bit data; the images get consecutive
+	seeds so a run is reproducible.
+    returns negative value on fail, 0 otherwise
+*/
+int32_t init_image(image_t* image, uint16_t x, uint16_t y) {
+  return init_image_ex(image, x, y, DIST_UNIFORM,
+                       atomic_fetch_add(&image_seed, 1));
+}
+
+/*
+        Frees image object.
+*/
+void free_image(image_t* image) {
+  if (!image_check_valid(image)) return;
+
+  if (image->map_base)
+    munmap(image->map_base, image->map_length);
+  else if (!image->borrowed)
+    free(image->pixels);
+}
+
+/*
+	maps the whole file read only, the pages stay shared with the page
+	cache. The access pattern hint matches the linear scan of
+	build_high_pixels().
+
+	return the mapping start or NULL on failure
+*/
+static uint8_t* map_file(const char* path, size_t* length) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) return NULL;
+
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+
+  void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close(fd); /* the mapping keeps the file referenced */
+
+  if (base == MAP_FAILED) return NULL;
+
+  madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+  *length = (size_t)st.st_size;
+
+  return (uint8_t*)base;
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HOST_BIG_ENDIAN 0
+#else
+#define HOST_BIG_ENDIAN 1
+#endif
+
+static void swap_pixels(uint16_t* pixels, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    pixels[i] = (uint16_t)(pixels[i] << 8 | pixels[i] >> 8);
+}
+
+/*
+	file image layout: pixels are stored in `strips` chunks at the given file
+	offsets, `strips` = 1 for raw and PGM files.
+*/
+typedef struct {
+  uint32_t rows;
+  uint32_t columns;
+  int8_t big_endian; /* pixels byte order */
+  uint32_t strips;
+  const uint64_t* strip_offsets;
+  const uint64_t* strip_lengths; /* in bytes */
+} file_layout_t;
+
+/*
+	sets up the image from a mapped file; the pixels are used in place, read
+	only, if they are stored contiguously at an aligned offset with the host
+	byte order. Otherwise they are copied to an owned buffer, swapped there
+	for the other byte order, and the file is unmapped: swapping within the
+	mapping would copy every page on write anyway.
+
+	return negative value on failure (the file is unmapped), 0 otherwise
+*/
+static int32_t image_from_map(image_t* image, uint8_t* base, size_t length,
+                              const file_layout_t* layout) {
+  uint64_t size = (uint64_t)layout->rows * layout->columns;
+  uint64_t bytes = size * sizeof(*image->pixels);
+  uint64_t total = 0;
+  int8_t contiguous = !(layout->strip_offsets[0] % sizeof(*image->pixels));
+  int8_t swap = layout->big_endian != HOST_BIG_ENDIAN;
+
+  if (!layout->rows || !layout->columns || layout->rows > UINT16_MAX ||
+      layout->columns > UINT16_MAX)
+    goto fail;
+
+  for (uint32_t i = 0; i < layout->strips; ++i) {
+    uint64_t off = layout->strip_offsets[i];
+    uint64_t len = layout->strip_lengths[i];
+
+    if (off > length || len > length - off) goto fail;
+
+    if (i && off != layout->strip_offsets[i - 1] + layout->strip_lengths[i - 1])
+      contiguous = 0;
+
+    total += len;
+  }
+
+  if (total < bytes) goto fail;
+
+  image->size_x = (uint16_t)layout->rows;
+  image->size_y = (uint16_t)layout->columns;
+
+  if (contiguous && !swap) {
+    image->pixels = (uint16_t*)(base + layout->strip_offsets[0]);
+    image->borrowed = 1;
+    image->map_base = base;
+    image->map_length = length;
+  } else {
+    uint8_t* pixels = (uint8_t*)malloc(bytes);
+    uint64_t copied = 0;
+
+    if (!pixels) goto fail;
+
+    for (uint32_t i = 0; i < layout->strips && copied < bytes; ++i) {
+      uint64_t len = layout->strip_lengths[i];
+
+      if (len > bytes - copied) len = bytes - copied;
+
+      memcpy(pixels + copied, base + layout->strip_offsets[i], len);
+      copied += len;
+    }
+
+    munmap(base, length);
+    image->pixels = (uint16_t*)pixels;
+    image->borrowed = 0;
+    image->map_base = NULL;
+    image->map_length = 0;
+
+    if (swap) swap_pixels(image->pixels, size);
+  }
+
+  return 0;
+
+fail:
+  munmap(base, length);
+  return -1;
+}
+
+/*
+	Maps a raw image file: x rows of y native 16-bit pixels, no header.
+
+	returns negative value on fail, 0 otherwise
+*/
+int32_t load_image_raw(image_t* image, const char* path, uint16_t x,
+                       uint16_t y) {
+  size_t length;
+  uint8_t* base;
+
+  if (!image || !path || !x || !y || !(base = map_file(path, &length)))
+    return -1;
+
+  uint64_t offset = 0;
+  uint64_t bytes = (uint64_t)x * y * sizeof(*image->pixels);
+  file_layout_t layout = {x, y, HOST_BIG_ENDIAN, 1, &offset, &bytes};
+
+  return image_from_map(image, base, length, &layout);
+}
+
+/* parses the next PGM header number, skipping white spaces and comments */
+static int32_t pgm_number(const uint8_t* base, size_t length, size_t* pos,
+                          uint32_t* number) {
+  size_t i = *pos;
+  uint64_t n = 0;
+
+  for (; i < length; ++i) {
+    if (base[i] == '#')
+      while (i < length && base[i] != '\n') ++i;
+    else if (base[i] != ' ' && base[i] != '\t' && base[i] != '\r' &&
+             base[i] != '\n')
+      break;
+  }
+
+  if (i >= length || base[i] < '0' || base[i] > '9') return -1;
+
+  for (; i < length && base[i] >= '0' && base[i] <= '9' && n <= UINT32_MAX;
+       ++i)
+    n = n * 10 + (base[i] - '0');
+
+  if (n > UINT32_MAX) return -1;
+
+  *pos = i;
+  *number = (uint32_t)n;
+
+  return 0;
+}
+
+static int32_t load_pgm(image_t* image, uint8_t* base, size_t length) {
+  uint32_t columns, rows, maxval;
+  size_t pos = 2;
+
+  if (pgm_number(base, length, &pos, &columns) ||
+      pgm_number(base, length, &pos, &rows) ||
+      pgm_number(base, length, &pos, &maxval) ||
+      maxval <= UINT8_MAX || maxval > UINT16_MAX || pos >= length) {
+    munmap(base, length);
+    return -1;
+  }
+
+  /* a single white space ends the header, 16-bit samples are big endian */
+  uint64_t offset = pos + 1;
+  uint64_t bytes = (uint64_t)rows * columns * sizeof(*image->pixels);
+  file_layout_t layout = {rows, columns, 1, 1, &offset, &bytes};
+
+  return image_from_map(image, base, length, &layout);
+}
+
+/* TIFF tags used by the loader */
+#define TIFF_IMAGE_WIDTH 256
+#define TIFF_IMAGE_LENGTH 257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_COMPRESSION 259
+#define TIFF_STRIP_OFFSETS 273
+#define TIFF_SAMPLES_PER_PIXEL 277
+#define TIFF_STRIP_BYTE_COUNTS 279
+
+#define TIFF_SHORT 3
+#define TIFF_LONG 4
+
+static uint32_t tiff_read(const uint8_t* p, uint32_t bytes, int8_t big) {
+  uint32_t v = 0;
+
+  for (uint32_t i = 0; i < bytes; ++i)
+    v |= (uint32_t)p[i] << (8 * (big ? bytes - 1 - i : i));
+
+  return v;
+}
+
+/*
+	reads the `index` value of an IFD entry, inline or at the value offset.
+
+	return negative value on failure, 0 otherwise
+*/
+static int32_t tiff_value(const uint8_t* base, size_t length,
+                          const uint8_t* entry, int8_t big, uint32_t index,
+                          uint64_t* value) {
+  uint32_t type = tiff_read(entry + 2, 2, big);
+  uint32_t count = tiff_read(entry + 4, 4, big);
+  uint32_t bytes = type == TIFF_SHORT ? 2 : type == TIFF_LONG ? 4 : 0;
+
+  if (!bytes || index >= count) return -1;
+
+  const uint8_t* p = entry + 8;
+
+  if ((uint64_t)count * bytes > 4) {
+    uint64_t off = tiff_read(entry + 8, 4, big) + (uint64_t)index * bytes;
+
+    if (off + bytes > length) return -1;
+
+    p = base + off;
+  } else {
+    p += index * bytes;
+  }
+
+  *value = tiff_read(p, bytes, big);
+
+  return 0;
+}
+
+/* uncompressed, single channel, 16-bit strips only */
+static int32_t load_tiff(image_t* image, uint8_t* base, size_t length) {
+  int8_t big = base[0] == 'M';
+  uint64_t ifd = tiff_read(base + 4, 4, big);
+  uint64_t columns = 0, rows = 0, bits = 16, compression = 1, samples = 1;
+  const uint8_t* strip_offsets = NULL;
+  const uint8_t* strip_lengths = NULL;
+  uint64_t* strips = NULL;
+  uint32_t count = 0;
+  int32_t err = -1;
+
+  if (ifd + 2 > length) goto out;
+
+  uint32_t entries = tiff_read(base + ifd, 2, big);
+
+  if (ifd + 2 + (uint64_t)entries * 12 > length) goto out;
+
+  for (uint32_t i = 0; i < entries; ++i) {
+    const uint8_t* entry = base + ifd + 2 + i * 12;
+    uint32_t tag = tiff_read(entry, 2, big);
+    uint64_t* value = NULL;
+
+    switch (tag) {
+      case TIFF_IMAGE_WIDTH:
+        value = &columns;
+        break;
+      case TIFF_IMAGE_LENGTH:
+        value = &rows;
+        break;
+      case TIFF_BITS_PER_SAMPLE:
+        value = &bits;
+        break;
+      case TIFF_COMPRESSION:
+        value = &compression;
+        break;
+      case TIFF_SAMPLES_PER_PIXEL:
+        value = &samples;
+        break;
+      case TIFF_STRIP_OFFSETS:
+        strip_offsets = entry;
+        count = tiff_read(entry + 4, 4, big);
+        break;
+      case TIFF_STRIP_BYTE_COUNTS:
+        strip_lengths = entry;
+        break;
+    }
+
+    if (value && tiff_value(base, length, entry, big, 0, value)) goto out;
+  }
+
+  if (bits != 16 || compression != 1 || samples != 1 || !strip_offsets ||
+      !strip_lengths || !count ||
+      tiff_read(strip_lengths + 4, 4, big) != count)
+    goto out;
+
+  strips = (uint64_t*)malloc(2 * (uint64_t)count * sizeof(*strips));
+
+  if (!strips) goto out;
+
+  for (uint32_t i = 0; i < count; ++i)
+    if (tiff_value(base, length, strip_offsets, big, i, &strips[i]) ||
+        tiff_value(base, length, strip_lengths, big, i, &strips[count + i]))
+      goto out;
+
+  file_layout_t layout = {(uint32_t)rows, (uint32_t)columns, big, count,
+                          strips, strips + count};
+
+  err = image_from_map(image, base, length, &layout);
+  free(strips);
+
+  return err;
+
+out:
+  free(strips);
+  munmap(base, length);
+  return err;
+}
+
+/*
+	Maps a PGM (P5, 16-bit) or TIFF (uncompressed 16-bit grayscale strips)
+	image file. Whenever possible the pixels are used in place within the
+	read only mapping and the image is marked as borrowed: free_image()
+	unmaps the file instead of freeing the pixels.
+
+	returns negative value on fail, 0 otherwise
+*/
+int32_t load_image(image_t* image, const char* path) {
+  size_t length;
+  uint8_t* base;
+
+  if (!image || !path || !(base = map_file(path, &length))) return -1;
+
+  if (length > 2 && base[0] == 'P' && base[1] == '5')
+    return load_pgm(image, base, length);
+
+  if (length > 8 && ((base[0] == 'I' && base[1] == 'I' && base[2] == 42 &&
+                      base[3] == 0) ||
+                     (base[0] == 'M' && base[1] == 'M' && base[2] == 0 &&
+                      base[3] == 42)))
+    return load_tiff(image, base, length);
+
+  munmap(base, length);
+
+  return -1;
+}
+
+/* check heap validity */
+static inline int8_t heap_check_valid(const heap_t* heap) {
+  return heap && heap->offsets && heap->values;
+}
+
+/* heap arrays alignment, the cache line size */
+#define HEAP_ALIGN 64
+
+static inline size_t heap_align(size_t bytes) {
+  return (bytes + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+}
+
+/*
+		Initialize heap object with provided capacity.
+
+        return 0 on success, != 0 otherwise
+*/
+int32_t init_heap(heap_t* heap, uint32_t capacity) {
+  if (!heap) return -1;
+
+  /*
+      a single cache line aligned allocation: the values array follows the
+      offsets array, from the next line
+  */
+  size_t values_at = heap_align((size_t)capacity * sizeof(*heap->offsets));
+  size_t bytes =
+      heap_align(values_at + (size_t)capacity * sizeof(*heap->values));
+
+  heap->offsets =
+      (uint32_t*)aligned_alloc(HEAP_ALIGN, bytes ? bytes : HEAP_ALIGN);
+
+  if (!heap->offsets) return -1;
+
+  heap->values = (uint16_t*)((uint8_t*)heap->offsets + values_at);
+  heap->capacity = capacity;
+  heap->size = 0;
+
+  return 0;
+}
+
+/*
+        Deallocates heap resources
+*/
+void free_heap(heap_t* heap) {
+  if (!heap_check_valid(heap)) return;
+
+  free(heap->offsets);
+}
+
+/* check if heap if full, i.e. reach its capacity */
+static inline int8_t heap_full(const heap_t* heap) {
+  return !heap_check_valid(heap) || heap->size >= heap->capacity;
+}
+
+/* check if heap is empty */
+static inline int8_t heap_empty(const heap_t* heap) {
+  return !heap_check_valid(heap) || !heap->size;
+}
+
+/* check if heap is empty */
+static inline uint16_t heap_peek(const heap_t* heap) {
+  return !heap_empty(heap) ? heap->values[0] : ~0;
+}
+
+/*
+	heap order: the lower value first and, for equal values, the greater
+	offset first, i.e. the item with greater offset is popped first.
+*/
+static inline int8_t heap_item_less(uint16_t value_a, uint32_t offset_a,
+                                    uint16_t value_b, uint32_t offset_b) {
+  /* bitwise operators, no branch */
+  return (value_a < value_b) | ((value_a == value_b) & (offset_a > offset_b));
+}
+
+/*
+	heaps from this size spill out of L1, their sift-downs prefetch the
+	grandchildren of the node being compared so the next level is in cache
+	by the time the winning child is known.
+*/
+#define HEAP_PREFETCH_ITEMS 8192
+
+/*
+	sifts the item down from `parent`, no validity check: callers make sure
+	`parent` < size. While both children exist the min child is selected
+	without branch; only the last parent may have a single child.
+*/
+static inline void heap_sift_down_with(uint32_t* offsets, uint16_t* values,
+                                       uint32_t size, uint32_t parent,
+                                       uint32_t offset, uint16_t value,
+                                       int8_t prefetch) {
+  uint32_t right;
+
+#ifdef HIGH_PIXEL_STATS
+  uint32_t from = parent;
+#endif
+
+  while ((right = (parent + 1) << 1) < size) {
+    /* the 4 grandchildren are contiguous, from the left child of left */
+    uint32_t grand = (right << 1) - 1;
+
+    if (prefetch && grand < size) {
+      __builtin_prefetch(values + grand);
+      __builtin_prefetch(offsets + grand);
+    }
+
+    uint32_t child = right - !heap_item_less(values[right], offsets[right],
+                                             values[right - 1],
+                                             offsets[right - 1]);
+
+    if (!heap_item_less(values[child], offsets[child], value, offset)) break;
+
+    values[parent] = values[child];
+    offsets[parent] = offsets[child];
+    parent = child;
+  }
+
+  /* single child left */
+  if (right == size &&
+      heap_item_less(values[size - 1], offsets[size - 1], value, offset)) {
+    values[parent] = values[size - 1];
+    offsets[parent] = offsets[size - 1];
+    parent = size - 1;
+  }
+
+  STATS_SIFT(from, parent);
+
+  values[parent] = value;
+  offsets[parent] = offset;
+}
+
+static inline void heap_sift_down(uint32_t* offsets, uint16_t* values,
+                                  uint32_t size, uint32_t parent,
+                                  uint32_t offset, uint16_t value) {
+  heap_sift_down_with(offsets, values, size, parent, offset, value,
+                      size >= HEAP_PREFETCH_ITEMS);
+}
+
+/*
+        Return the min child index (within the heap) for a parent
+        or negative if doesn't exits.
+*/
+int32_t heap_min_child_for_parent(const heap_t* heap, uint32_t parent) {
+  if (!heap_check_valid(heap)) return -1;
+
+  uint32_t left = (parent << 1) + 1;
+
+  if (left >= heap->size) return -1;
+
+  uint32_t right = (parent + 1) << 1;
+
+  if (right >= heap->size) return left;
+
+  return heap_item_less(heap->values[left], heap->offsets[left],
+                        heap->values[right], heap->offsets[right])
+             ? left
+             : right;
+}
+
+/*
+        Push new item in heap min.
+
+        return 0 on success, != 0 otherwise
+*/
+int32_t heap_min_push(heap_t* heap, uint32_t offset, uint16_t value) {
+  if (heap_full(heap)) return -1;
+
+  STATS_ADD(pushes, 1);
+
+  uint32_t* offsets = heap->offsets;
+  uint16_t* values = heap->values;
+  uint32_t parent = heap->size;
+
+  while (parent > 0) { /* stop if we reached the root */
+    uint32_t child = parent;
+    parent = (parent - 1) >> 1; /* get parent index: (child - 1) / 2 */
+
+    /* reach insertion point */
+    if (heap_item_less(values[parent], offsets[parent], value, offset)) {
+      parent = child;
+      break;
+    }
+
+    /* move parent to child location */
+    values[child] = values[parent];
+    offsets[child] = offsets[parent];
+  }
+
+  values[parent] = value;
+  offsets[parent] = offset;
+  heap->size += 1;
+
+  return 0;
+}
+
+/*
+        Pop min element from heap, the popped item is left at
+        heap->offsets[heap->size] / heap->values[heap->size].
+
+        return negative value on failure, >= 0 otherwise representing the
+        offset: offsets from 2^31 read as failures, take them from the array
+*/
+int32_t heap_min_pop(heap_t* heap) {
+  if (heap_empty(heap)) return -1;
+
+  STATS_ADD(pops, 1);
+
+  uint32_t* offsets = heap->offsets;
+  uint16_t* values = heap->values;
+  uint32_t size = heap->size - 1; /* new heap size */
+  uint32_t offset;
+  uint16_t value; /* tumble down value */
+
+  heap->size = size;
+
+  /* reach last element */
+  if (!size) return offsets[0];
+
+  /* if not the last element then tumble down root */
+
+  /* swap the last and the first element so the latter becomes the root */
+  SWAP(values[size], values[0], value);
+  SWAP(offsets[size], offsets[0], offset);
+
+  heap_sift_down(offsets, values, size, 0, offset, value);
+
+  return offsets[size];
+}
+
+/*
+        Replace the min element with a new item: equivalent to a pop
+        followed by a push but with a single traversal. The replaced offset
+        is stored in `replaced` unless NULL, it takes the whole 32 bits.
+
+        return negative value on failure, 0 otherwise
+*/
+int32_t heap_min_replace_top(heap_t* heap, uint32_t offset, uint16_t value,
+                             uint32_t* replaced) {
+  if (heap_empty(heap)) return -1;
+
+  STATS_ADD(replaces, 1);
+
+  if (replaced) *replaced = heap->offsets[0];
+
+  heap_sift_down(heap->offsets, heap->values, heap->size, 0, offset, value);
+
+  return 0;
+}
+
+/*
+        Restore the heap property for the whole array, O(size).
+*/
+void heap_heapify(heap_t* heap) {
+  if (!heap_check_valid(heap) || heap->size < 2) return;
+
+  uint32_t* offsets = heap->offsets;
+  uint16_t* values = heap->values;
+
+  for (uint32_t root = heap->size >> 1; root-- > 0;)
+    heap_sift_down(offsets, values, heap->size, root, offsets[root],
+                   values[root]);
+}
+
+/*
+        Offer an item to the heap: push it if the heap is not full,
+        otherwise replace the heap minimum if the item ranks higher.
+        Unlike the scan kernels, no assumption is made on the offset order.
+
+        return negative value on failure, 0 otherwise
+*/
+int32_t heap_min_offer(heap_t* heap, uint32_t offset, uint16_t value) {
+  if (!heap_check_valid(heap)) return -1;
+
+  if (!heap_full(heap)) return heap_min_push(heap, offset, value);
+
+  if (heap_empty(heap) ||
+      !heap_item_less(heap->values[0], heap->offsets[0], value, offset))
+    return 0;
+
+  return heap_min_replace_top(heap, offset, value, NULL);
+}
+
+/*
+	max heap counterpart, keeps the bottom X pixels: the root is the item
+	that goes first, the greatest value and, for equal values, the greater
+	offset, so the lower offsets win the ties as in the min heap.
+*/
+static inline int8_t heap_max_item_greater(uint16_t value_a, uint32_t offset_a,
+                                           uint16_t value_b,
+                                           uint32_t offset_b) {
+  return (value_a > value_b) | ((value_a == value_b) & (offset_a > offset_b));
+}
+
+/* see heap_sift_down() */
+static inline void heap_max_sift_down(uint32_t* offsets, uint16_t* values,
+                                      uint32_t size, uint32_t parent,
+                                      uint32_t offset, uint16_t value) {
+  uint32_t right;
+
+#ifdef HIGH_PIXEL_STATS
+  uint32_t from = parent;
+#endif
+
+  while ((right = (parent + 1) << 1) < size) {
+    uint32_t child = right - !heap_max_item_greater(values[right],
+                                                    offsets[right],
+                                                    values[right - 1],
+                                                    offsets[right - 1]);
+
+    if (!heap_max_item_greater(values[child], offsets[child], value, offset))
+      break;
+
+    values[parent] = values[child];
+    offsets[parent] = offsets[child];
+    parent = child;
+  }
+
+  /* single child left */
+  if (right == size && heap_max_item_greater(values[size - 1],
+                                             offsets[size - 1], value,
+                                             offset)) {
+    values[parent] = values[size - 1];
+    offsets[parent] = offsets[size - 1];
+    parent = size - 1;
+  }
+
+  STATS_SIFT(from, parent);
+
+  values[parent] = value;
+  offsets[parent] = offset;
+}
+
+/* max heap top, 0 if the heap is empty */
+static inline uint16_t heap_max_peek(const heap_t* heap) {
+  return !heap_empty(heap) ? heap->values[0] : 0;
+}
+
+/*
+        Push new item in heap max.
+
+        return 0 on success, != 0 otherwise
+*/
+int32_t heap_max_push(heap_t* heap, uint32_t offset, uint16_t value) {
+  if (heap_full(heap)) return -1;
+
+  STATS_ADD(pushes, 1);
+
+  uint32_t* offsets = heap->offsets;
+  uint16_t* values = heap->values;
+  uint32_t parent = heap->size;
+
+  while (parent > 0) {
+    uint32_t child = parent;
+    parent = (parent - 1) >> 1;
+
+    if (heap_max_item_greater(values[parent], offsets[parent], value,
+                              offset)) {
+      parent = child;
+      break;
+    }
+
+    values[child] = values[parent];
+    offsets[child] = offsets[parent];
+  }
+
+  values[parent] = value;
+  offsets[parent] = offset;
+  heap->size += 1;
+
+  return 0;
+}
+
+/*
+        Pop max element from heap, it lands at offsets[size].
+
+        return negative value on failure, >= 0 otherwise representing the
+        offset, see heap_min_pop() for offsets from 2^31
+*/
+int32_t heap_max_pop(heap_t* heap) {
+  if (heap_empty(heap)) return -1;
+
+  STATS_ADD(pops, 1);
+
+  uint32_t* offsets = heap->offsets;
+  uint16_t* values = heap->values;
+  uint32_t size = heap->size - 1;
+  uint32_t offset;
+  uint16_t value;
+
+  heap->size = size;
+
+  if (!size) return offsets[0];
+
+  SWAP(values[size], values[0], value);
+  SWAP(offsets[size], offsets[0], offset);
+
+  heap_max_sift_down(offsets, values, size, 0, offset, value);
+
+  return offsets[size];
+}
+
+/*
+        Replace the max element with a new item, the replaced offset is
+        stored in `replaced` unless NULL.
+
+        return negative value on failure, 0 otherwise
+*/
+int32_t heap_max_replace_top(heap_t* heap, uint32_t offset, uint16_t value,
+                             uint32_t* replaced) {
+  if (heap_empty(heap)) return -1;
+
+  STATS_ADD(replaces, 1);
+
+  if (replaced) *replaced = heap->offsets[0];
+
+  heap_max_sift_down(heap->offsets, heap->values, heap->size, 0, offset, value);
+
+  return 0;
+}
+
+/* prints heap_t object */
+void heap_print(const heap_t* heap, uint16_t columns) {
+  for (int32_t i = 0; i < heap->size; ++i)
+    printf(" [%d, %d, %hu] ", heap->offsets[i] / columns,
+           heap->offsets[i] % columns, heap->values[i]);
+  printf("\n");
+}
+
+/*
+	64-bit pixel key with the same order as the heap: the value in the high
+	bits and the complemented offset in the low bits, so for equal values
+	the lower offset yields the greater key.
+*/
+static inline uint64_t pixel_key(uint16_t value, uint32_t offset) {
+  return ((uint64_t)value << 32) | (uint32_t)~offset;
+}
+
+static inline uint16_t pixel_key_value(uint64_t key) {
+  return (uint16_t)(key >> 32);
+}
+
+static inline uint32_t pixel_key_offset(uint64_t key) {
+  return ~(uint32_t)key;
+}
+
+/*
+	Initialize a packed heap with the provided capacity.
+
+	return 0 on success, != 0 otherwise
+*/
+int32_t init_heap_key(heap_key_t* heap, uint32_t capacity) {
+  if (!heap) return -1;
+
+  size_t bytes = heap_align((size_t)capacity * sizeof(*heap->keys));
+
+  heap->keys = (uint64_t*)aligned_alloc(HEAP_ALIGN, bytes ? bytes : HEAP_ALIGN);
+
+  if (!heap->keys) return -1;
+
+  heap->capacity = capacity;
+  heap->size = 0;
+
+  return 0;
+}
+
+/* Deallocates packed heap resources */
+void free_heap_key(heap_key_t* heap) {
+  if (!heap || !heap->keys) return;
+
+  free(heap->keys);
+  heap->keys = NULL;
+}
+
+/* see heap_sift_down_with() */
+static inline void heap_key_sift_down_with(uint64_t* keys, uint32_t size,
+                                           uint32_t parent, uint64_t key,
+                                           int8_t prefetch) {
+  uint32_t right;
+
+#ifdef HIGH_PIXEL_STATS
+  uint32_t from = parent;
+#endif
+
+  while ((right = (parent + 1) << 1) < size) {
+    uint32_t grand = (right << 1) - 1;
+
+    if (prefetch && grand < size) __builtin_prefetch(keys + grand);
+
+    uint32_t child = right - !(keys[right] < keys[right - 1]);
+
+    if (keys[child] >= key) break;
+
+    keys[parent] = keys[child];
+    parent = child;
+  }
+
+  if (right == size && keys[size - 1] < key) {
+    keys[parent] = keys[size - 1];
+    parent = size - 1;
+  }
+
+  STATS_SIFT(from, parent);
+
+  keys[parent] = key;
+}
+
+static inline void heap_key_sift_down(uint64_t* keys, uint32_t size,
+                                      uint32_t parent, uint64_t key) {
+  heap_key_sift_down_with(keys, size, parent, key,
+                          size >= HEAP_PREFETCH_ITEMS);
+}
+
+/*
+	Pushes a key into the packed heap.
+
+	return negative value on failure, >= 0 otherwise
+*/
+static inline int32_t heap_key_push(heap_key_t* heap, uint64_t key) {
+  if (heap->size >= heap->capacity) return -1;
+
+  STATS_ADD(pushes, 1);
+
+  uint64_t* keys = heap->keys;
+  uint32_t child = heap->size++;
+
+  for (uint32_t parent; child && keys[parent = (child - 1) >> 1] > key;
+       child = parent)
+    keys[child] = keys[parent];
+
+  keys[child] = key;
+
+  return 0;
+}
+
+/* replaces the min key of a non empty packed heap */
+static inline void heap_key_replace_top(heap_key_t* heap, uint64_t key) {
+  STATS_ADD(replaces, 1);
+
+  heap_key_sift_down(heap->keys, heap->size, 0, key);
+}
+
+/* pops the min key of a non empty packed heap */
+static inline uint64_t heap_key_pop(heap_key_t* heap) {
+  STATS_ADD(pops, 1);
+
+  uint64_t* keys = heap->keys;
+  uint64_t top = keys[0];
+  uint32_t size = --heap->size;
+
+  if (size) heap_key_sift_down(keys, size, 0, keys[size]);
+
+  return top;
+}
+
+/*
+	division by a runtime constant through a precomputed 64-bit reciprocal
+	(Lemire, Kaser and Kurz): for 32-bit numerators and divisors > 1,
+	n / d == (M * n) >> 64 with M = 2^64 / d rounded up.
+*/
+static inline uint64_t reciprocal_u32(uint32_t divisor) {
+  return divisor > 1 ? UINT64_MAX / divisor + 1 : 0;
+}
+
+static inline uint32_t divide_u32(uint32_t n, uint32_t divisor,
+                                  uint64_t reciprocal) {
+  return divisor > 1 ? (uint32_t)(((__uint128_t)reciprocal * n) >> 64) : n;
+}
+
+/*
+	Copies the heap items, in heap order, as (row, column, value) into the
+	caller arrays of heap->size items, `columns` being the image columns.
+	The heap is left untouched, O(X).
+
+	return negative value on failure, the number of items otherwise
+*/
+int64_t high_pixels_extract(const heap_t* heap, uint16_t columns,
+                            uint16_t* rows, uint16_t* cols, uint16_t* values) {
+  if (!heap_check_valid(heap) || !columns || !rows || !cols || !values)
+    return -1;
+
+  uint64_t reciprocal = reciprocal_u32(columns);
+
+  for (uint32_t i = 0; i < heap->size; ++i) {
+    uint32_t offset = heap->offsets[i];
+    uint32_t row = divide_u32(offset, columns, reciprocal);
+
+    rows[i] = (uint16_t)row;
+    cols[i] = (uint16_t)(offset - row * columns);
+    values[i] = heap->values[i];
+  }
+
+  return heap->size;
+}
+
+/* extraction order key: value, then the lower (row, column) first */
+static inline uint64_t extract_key(const uint16_t* rows, const uint16_t* cols,
+                                   const uint16_t* values, uint32_t i) {
+  return pixel_key(values[i], (uint32_t)rows[i] << 16 | cols[i]);
+}
+
+static inline void extract_swap(uint16_t* rows, uint16_t* cols,
+                                uint16_t* values, uint32_t a, uint32_t b) {
+  uint16_t tmp;
+
+  SWAP(rows[a], rows[b], tmp);
+  SWAP(cols[a], cols[b], tmp);
+  SWAP(values[a], values[b], tmp);
+}
+
+/*
+	sorts the extracted arrays in descending key order, in place: quicksort
+	with a median of 3 pivot, recursing on the smaller side, and insertion
+	sort for the short ranges. Keys are unique.
+*/
+static void extract_sort(uint16_t* rows, uint16_t* cols, uint16_t* values,
+                         uint32_t count) {
+  while (count > 16) {
+    uint32_t mid = count / 2, last = count - 1;
+
+    /* order first, mid and last, the pivot ends up at mid */
+    if (extract_key(rows, cols, values, mid) >
+        extract_key(rows, cols, values, 0))
+      extract_swap(rows, cols, values, mid, 0);
+    if (extract_key(rows, cols, values, last) >
+        extract_key(rows, cols, values, mid)) {
+      extract_swap(rows, cols, values, last, mid);
+      if (extract_key(rows, cols, values, mid) >
+          extract_key(rows, cols, values, 0))
+        extract_swap(rows, cols, values, mid, 0);
+    }
+
+    uint64_t pivot = extract_key(rows, cols, values, mid);
+    uint32_t i = 0, j = last;
+
+    /* Hoare partition, the greater keys first */
+    for (;;) {
+      while (extract_key(rows, cols, values, i) > pivot) ++i;
+      while (extract_key(rows, cols, values, j) < pivot) --j;
+      if (i >= j) break;
+      extract_swap(rows, cols, values, i++, j--);
+    }
+
+    /* [0, j] and [j + 1, count) */
+    uint32_t left = j + 1;
+
+    if (left < count - left) {
+      extract_sort(rows, cols, values, left);
+      rows += left, cols += left, values += left, count -= left;
+    } else {
+      extract_sort(rows + left, cols + left, values + left, count - left);
+      count = left;
+    }
+  }
+
+  for (uint32_t i = 1; i < count; ++i) {
+    uint64_t key = extract_key(rows, cols, values, i);
+    uint16_t row = rows[i], col = cols[i], value = values[i];
+    uint32_t j = i;
+
+    for (; j > 0 && extract_key(rows, cols, values, j - 1) < key; --j) {
+      rows[j] = rows[j - 1];
+      cols[j] = cols[j - 1];
+      values[j] = values[j - 1];
+    }
+
+    rows[j] = row;
+    cols[j] = col;
+    values[j] = value;
+  }
+}
+
+/*
+	Same as high_pixels_extract() but the items are ranked: the highest
+	value first and, for equal values, the lower offset first. The heap is
+	left untouched, O(X log X).
+
+	return negative value on failure, the number of items otherwise
+*/
+int64_t high_pixels_extract_sorted(const heap_t* heap, uint16_t columns,
+                                   uint16_t* rows, uint16_t* cols,
+                                   uint16_t* values) {
+  STATS_START(began);
+
+  int64_t count = high_pixels_extract(heap, columns, rows, cols, values);
+
+  if (count > 1) extract_sort(rows, cols, values, (uint32_t)count);
+
+  STATS_PHASE(STATS_PHASE_EXTRACT, began);
+
+  return count;
+}
+
+/*
+	push pixels until the heap reaches its capacity.
+
+	return the index of the first pixel not consumed
+*/
+static inline uint32_t scan_fill(heap_t* heap, const uint16_t* pixels,
+                                 uint32_t base, uint32_t count) {
+  uint32_t i = 0;
+
+  for (; i < count && !heap_full(heap); ++i)
+    heap_min_push(heap, base + i, pixels[i]);
+
+  return i;
+}
+
+/*
+	replace the heap minimum with the pixel if the latter is greater;
+	the heap must be full at this point.
+*/
+static inline void scan_candidate(heap_t* heap, uint32_t offset,
+                                  uint16_t value) {
+  STATS_ADD(candidates, 1);
+
+  if (heap->values[0] < value) {
+    STATS_ADD(replaces, 1);
+    heap_sift_down(heap->offsets, heap->values, heap->size, 0, offset, value);
+  }
+}
+
+static int32_t scan_scalar(heap_t* heap, const uint16_t* pixels, uint32_t base,
+                           uint32_t count) {
+  /*
+      while the heap is not full insert the pixel offset-value pair;
+      the offset will be used later to compute the pixel (x,y)
+      coordinates.
+  */
+  uint32_t i = scan_fill(heap, pixels, base, count);
+
+  STATS_ADD(scanned, count);
+
+  if (heap_empty(heap)) return 0;
+
+  /*
+      once the heap reaches the desired capacity, a pixel greater than the
+      minimum heap value replaces it.
+  */
+  for (; i < count; ++i) scan_candidate(heap, base + i, pixels[i]);
+
+  return 0;
+}
+
+#ifdef HAVE_X86_KERNELS
+/*
+	16 pixels per iteration: the saturated difference `pixel - min` is
+	non-zero only for the pixels greater than the heap minimum, so a single
+	test tells if the whole block can be skipped.
+*/
+__attribute__((target("sse4.1"))) static int32_t scan_sse41(
+    heap_t* heap, const uint16_t* pixels, uint32_t base, uint32_t count) {
+  uint32_t i = scan_fill(heap, pixels, base, count);
+  const __m128i zero = _mm_setzero_si128();
+
+  if (heap_empty(heap)) {
+    STATS_ADD(scanned, count);
+    return 0;
+  }
+
+  for (; i + 16 <= count; i += 16) {
+    uint16_t min = heap->values[0];
+
+    /* nothing can beat the heap anymore, the rest counts as scanned */
+    if (min == 0xffff) {
+      STATS_ADD(scanned, count);
+      return 0;
+    }
+
+    __m128i thr = _mm_set1_epi16((int16_t)min);
+    __m128i lo = _mm_subs_epu16(
+        _mm_loadu_si128((const __m128i*)(pixels + i)), thr);
+    __m128i hi = _mm_subs_epu16(
+        _mm_loadu_si128((const __m128i*)(pixels + i + 8)), thr);
+    __m128i any = _mm_or_si128(lo, hi);
+
+    if (_mm_testz_si128(any, any)) continue;
+
+    /* 2 mask bits per 16-bit lane */
+    uint32_t mask =
+        ~((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(lo, zero)) |
+          ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(hi, zero)) << 16));
+
+    while (mask) {
+      uint32_t j = i + (__builtin_ctz(mask) >> 1);
+      mask &= mask - 1;
+      mask &= mask - 1;
+      scan_candidate(heap, base + j, pixels[j]);
+    }
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return scan_scalar(heap, pixels + i, base + i, count - i);
+}
+
+/* same as scan_sse41() but with 32 pixels per iteration */
+__attribute__((target("avx2"))) static int32_t scan_avx2(heap_t* heap,
+                                                         const uint16_t* pixels,
+                                                         uint32_t base,
+                                                         uint32_t count) {
+  uint32_t i = scan_fill(heap, pixels, base, count);
+  const __m256i zero = _mm256_setzero_si256();
+
+  if (heap_empty(heap)) {
+    STATS_ADD(scanned, count);
+    return 0;
+  }
+
+  for (; i + 32 <= count; i += 32) {
+    uint16_t min = heap->values[0];
+
+    /* nothing can beat the heap anymore, the rest counts as scanned */
+    if (min == 0xffff) {
+      STATS_ADD(scanned, count);
+      return 0;
+    }
+
+    __m256i thr = _mm256_set1_epi16((int16_t)min);
+    __m256i lo = _mm256_subs_epu16(
+        _mm256_loadu_si256((const __m256i*)(pixels + i)), thr);
+    __m256i hi = _mm256_subs_epu16(
+        _mm256_loadu_si256((const __m256i*)(pixels + i + 16)), thr);
+    __m256i any = _mm256_or_si256(lo, hi);
+
+    if (_mm256_testz_si256(any, any)) continue;
+
+    /* 2 mask bits per 16-bit lane */
+    uint64_t mask = ~(
+        (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(lo, zero)) |
+        ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(hi, zero))
+         << 32));
+
+    while (mask) {
+      uint32_t j = i + (__builtin_ctzll(mask) >> 1);
+      mask &= mask - 1;
+      mask &= mask - 1;
+      scan_candidate(heap, base + j, pixels[j]);
+    }
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return scan_scalar(heap, pixels + i, base + i, count - i);
+}
+/*
+	same as scan_avx2() with 64 pixels per iteration; the unsigned compares
+	give one mask bit per pixel.
+*/
+__attribute__((target("avx512bw"))) static int32_t scan_avx512(
+    heap_t* heap, const uint16_t* pixels, uint32_t base, uint32_t count) {
+  uint32_t i = scan_fill(heap, pixels, base, count);
+
+  if (heap_empty(heap)) {
+    STATS_ADD(scanned, count);
+    return 0;
+  }
+
+  for (; i + 64 <= count; i += 64) {
+    uint16_t min = heap->values[0];
+
+    /* nothing can beat the heap anymore, the rest counts as scanned */
+    if (min == 0xffff) {
+      STATS_ADD(scanned, count);
+      return 0;
+    }
+
+    __m512i thr = _mm512_set1_epi16((int16_t)min);
+    uint64_t mask =
+        (uint64_t)_mm512_cmpgt_epu16_mask(
+            _mm512_loadu_si512((const void*)(pixels + i)), thr) |
+        (uint64_t)_mm512_cmpgt_epu16_mask(
+            _mm512_loadu_si512((const void*)(pixels + i + 32)), thr)
+            << 32;
+
+    while (mask) {
+      uint32_t j = i + __builtin_ctzll(mask);
+      mask &= mask - 1;
+      scan_candidate(heap, base + j, pixels[j]);
+    }
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return scan_scalar(heap, pixels + i, base + i, count - i);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+/* 16 pixels per iteration, candidates are then extracted with scalar code */
+static int32_t scan_neon(heap_t* heap, const uint16_t* pixels, uint32_t base,
+                         uint32_t count) {
+  uint32_t i = scan_fill(heap, pixels, base, count);
+
+  if (heap_empty(heap)) {
+    STATS_ADD(scanned, count);
+    return 0;
+  }
+
+  for (; i + 16 <= count; i += 16) {
+    uint16_t min = heap->values[0];
+
+    /* nothing can beat the heap anymore, the rest counts as scanned */
+    if (min == 0xffff) {
+      STATS_ADD(scanned, count);
+      return 0;
+    }
+
+    uint16x8_t thr = vdupq_n_u16(min);
+    uint16x8_t lo = vqsubq_u16(vld1q_u16(pixels + i), thr);
+    uint16x8_t hi = vqsubq_u16(vld1q_u16(pixels + i + 8), thr);
+
+    if (!vmaxvq_u16(vorrq_u16(lo, hi))) continue;
+
+    for (uint32_t j = i; j < i + 16; ++j)
+      scan_candidate(heap, base + j, pixels[j]);
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return scan_scalar(heap, pixels + i, base + i, count - i);
+}
+#endif
+
+/*
+	returns the scan kernel implementation or NULL if the kernel is not
+	supported by the current CPU.
+*/
+static scan_kernel_fn scan_kernel_get(scan_kernel_t kernel) {
+  switch (kernel) {
+    case SCAN_KERNEL_AUTO:
+#ifdef HAVE_X86_KERNELS
+      if (__builtin_cpu_supports("avx512bw")) return scan_avx512;
+      if (__builtin_cpu_supports("avx2")) return scan_avx2;
+      if (__builtin_cpu_supports("sse4.1")) return scan_sse41;
+#endif
+#ifdef HAVE_NEON_KERNEL
+      return scan_neon;
+#endif
+      return scan_scalar;
+    case SCAN_KERNEL_SCALAR:
+      return scan_scalar;
+#ifdef HAVE_X86_KERNELS
+    case SCAN_KERNEL_SSE41:
+      return __builtin_cpu_supports("sse4.1") ? scan_sse41 : NULL;
+    case SCAN_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2") ? scan_avx2 : NULL;
+    case SCAN_KERNEL_AVX512:
+      return __builtin_cpu_supports("avx512bw") ? scan_avx512 : NULL;
+#endif
+#ifdef HAVE_NEON_KERNEL
+    case SCAN_KERNEL_NEON:
+      return scan_neon;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+/*
+	find kernels: return the index of the first pixel >= threshold or `count`
+	if there is none; used by the passes that only look for rare pixels.
+*/
+typedef uint32_t (*find_kernel_fn)(const uint16_t* pixels, uint32_t count,
+                                   uint16_t threshold);
+
+static uint32_t find_scalar(const uint16_t* pixels, uint32_t count,
+                            uint16_t threshold) {
+  uint32_t i = 0;
+
+  while (i < count && pixels[i] < threshold) ++i;
+
+  return i;
+}
+
+#ifdef HAVE_X86_KERNELS
+/* max(pixel, threshold) == pixel iff pixel >= threshold */
+__attribute__((target("sse4.1"))) static uint32_t find_sse41(
+    const uint16_t* pixels, uint32_t count, uint16_t threshold) {
+  __m128i thr = _mm_set1_epi16((int16_t)threshold);
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(pixels + i));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi16(_mm_max_epu16(v, thr), v));
+
+    if (mask) return i + (__builtin_ctz(mask) >> 1);
+  }
+
+  return i + find_scalar(pixels + i, count - i, threshold);
+}
+
+__attribute__((target("avx2"))) static uint32_t find_avx2(
+    const uint16_t* pixels, uint32_t count, uint16_t threshold) {
+  __m256i thr = _mm256_set1_epi16((int16_t)threshold);
+  uint32_t i = 0;
+
+  /* 32 pixels per iteration while nothing is found */
+  for (; i + 32 <= count; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(pixels + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(pixels + i + 16));
+    __m256i ge_a = _mm256_cmpeq_epi16(_mm256_max_epu16(a, thr), a);
+    __m256i ge_b = _mm256_cmpeq_epi16(_mm256_max_epu16(b, thr), b);
+    __m256i any = _mm256_or_si256(ge_a, ge_b);
+
+    if (!_mm256_testz_si256(any, any)) {
+      uint64_t mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(ge_a) |
+                      (uint64_t)(uint32_t)_mm256_movemask_epi8(ge_b) << 32;
+
+      return i + (__builtin_ctzll(mask) >> 1);
+    }
+  }
+
+  for (; i + 16 <= count; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(pixels + i));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi16(_mm256_max_epu16(v, thr), v));
+
+    if (mask) return i + (__builtin_ctz(mask) >> 1);
+  }
+
+  return i + find_scalar(pixels + i, count - i, threshold);
+}
+
+__attribute__((target("avx512bw"))) static uint32_t find_avx512(
+    const uint16_t* pixels, uint32_t count, uint16_t threshold) {
+  __m512i thr = _mm512_set1_epi16((int16_t)threshold);
+  uint32_t i = 0;
+
+  /* 64 pixels per iteration while nothing is found */
+  for (; i + 64 <= count; i += 64) {
+    uint64_t mask =
+        (uint64_t)_mm512_cmpge_epu16_mask(
+            _mm512_loadu_si512((const void*)(pixels + i)), thr) |
+        (uint64_t)_mm512_cmpge_epu16_mask(
+            _mm512_loadu_si512((const void*)(pixels + i + 32)), thr)
+            << 32;
+
+    if (mask) return i + __builtin_ctzll(mask);
+  }
+
+  return i + find_avx2(pixels + i, count - i, threshold);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static uint32_t find_neon(const uint16_t* pixels, uint32_t count,
+                          uint16_t threshold) {
+  uint16x8_t thr = vdupq_n_u16(threshold);
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8)
+    if (vmaxvq_u16(vcgeq_u16(vld1q_u16(pixels + i), thr))) break;
+
+  return i + find_scalar(pixels + i, count - i, threshold);
+}
+#endif
+
+/* find kernel counterpart of scan_kernel_get() */
+static find_kernel_fn find_kernel_get(scan_kernel_t kernel) {
+  scan_kernel_fn scan = scan_kernel_get(kernel);
+
+#ifdef HAVE_X86_KERNELS
+  if (scan == scan_avx512) return find_avx512;
+  if (scan == scan_avx2) return find_avx2;
+  if (scan == scan_sse41) return find_sse41;
+#endif
+#ifdef HAVE_NEON_KERNEL
+  if (scan == scan_neon) return find_neon;
+#endif
+
+  return scan ? find_scalar : NULL;
+}
+
+/*
+	max kernels: return the greatest of `count` pixels, 0 if there is none;
+	the building block of the X = 1 argmax.
+*/
+typedef uint16_t (*max_kernel_fn)(const uint16_t* pixels, uint32_t count);
+
+static uint16_t max_scalar(const uint16_t* pixels, uint32_t count) {
+  uint16_t max = 0;
+
+  for (uint32_t i = 0; i < count; ++i)
+    if (pixels[i] > max) max = pixels[i];
+
+  return max;
+}
+
+#ifdef HAVE_X86_KERNELS
+/* max of 8 lanes: the minimum position of their complement */
+__attribute__((target("sse4.1"))) static inline uint16_t max_lanes_sse41(
+    __m128i v) {
+  __m128i inverted = _mm_xor_si128(v, _mm_set1_epi32(-1));
+
+  return (uint16_t)~_mm_extract_epi16(_mm_minpos_epu16(inverted), 0);
+}
+
+__attribute__((target("sse4.1"))) static uint16_t max_sse41(
+    const uint16_t* pixels, uint32_t count) {
+  __m128i max = _mm_setzero_si128();
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8)
+    max = _mm_max_epu16(max, _mm_loadu_si128((const __m128i*)(pixels + i)));
+
+  uint16_t lanes = max_lanes_sse41(max);
+  uint16_t tail = max_scalar(pixels + i, count - i);
+
+  return lanes > tail ? lanes : tail;
+}
+
+__attribute__((target("avx2"))) static uint16_t max_avx2(
+    const uint16_t* pixels, uint32_t count) {
+  __m256i a = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+  uint32_t i = 0;
+
+  /* two accumulators, 32 pixels per iteration */
+  for (; i + 32 <= count; i += 32) {
+    a = _mm256_max_epu16(a, _mm256_loadu_si256((const __m256i*)(pixels + i)));
+    b = _mm256_max_epu16(
+        b, _mm256_loadu_si256((const __m256i*)(pixels + i + 16)));
+  }
+
+  __m256i max = _mm256_max_epu16(a, b);
+  uint16_t lanes = max_lanes_sse41(_mm_max_epu16(
+      _mm256_castsi256_si128(max), _mm256_extracti128_si256(max, 1)));
+  uint16_t tail = max_scalar(pixels + i, count - i);
+
+  return lanes > tail ? lanes : tail;
+}
+
+__attribute__((target("avx512bw"))) static uint16_t max_avx512(
+    const uint16_t* pixels, uint32_t count) {
+  __m512i a = _mm512_setzero_si512(), b = _mm512_setzero_si512();
+  uint32_t i = 0;
+
+  /* two accumulators, 64 pixels per iteration */
+  for (; i + 64 <= count; i += 64) {
+    a = _mm512_max_epu16(a, _mm512_loadu_si512((const void*)(pixels + i)));
+    b = _mm512_max_epu16(b,
+                         _mm512_loadu_si512((const void*)(pixels + i + 32)));
+  }
+
+  __m512i max = _mm512_max_epu16(a, b);
+  __m256i half = _mm256_max_epu16(_mm512_castsi512_si256(max),
+                                  _mm512_extracti64x4_epi64(max, 1));
+  uint16_t lanes = max_lanes_sse41(_mm_max_epu16(
+      _mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1)));
+  uint16_t tail = max_avx2(pixels + i, count - i);
+
+  return lanes > tail ? lanes : tail;
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static uint16_t max_neon(const uint16_t* pixels, uint32_t count) {
+  uint16x8_t max = vdupq_n_u16(0);
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) max = vmaxq_u16(max, vld1q_u16(pixels + i));
+
+  uint16_t lanes = vmaxvq_u16(max);
+  uint16_t tail = max_scalar(pixels + i, count - i);
+
+  return lanes > tail ? lanes : tail;
+}
+#endif
+
+/* max kernel counterpart of scan_kernel_get() */
+static max_kernel_fn max_kernel_get(scan_kernel_t kernel) {
+  scan_kernel_fn scan = scan_kernel_get(kernel);
+
+#ifdef HAVE_X86_KERNELS
+  if (scan == scan_avx512) return max_avx512;
+  if (scan == scan_avx2) return max_avx2;
+  if (scan == scan_sse41) return max_sse41;
+#endif
+#ifdef HAVE_NEON_KERNEL
+  if (scan == scan_neon) return max_neon;
+#endif
+
+  return scan ? max_scalar : NULL;
+}
+
+/*
+	computes the first X high value pixels using the provided scan kernel.
+
+	return negative value on failure (including unsupported kernel),
+	>= 0 otherwise
+ */
+int32_t build_high_pixels_with(const image_t* image, heap_t* high_pixels,
+                               scan_kernel_t kernel) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  scan_kernel_fn scan = scan_kernel_get(kernel);
+
+  if (!scan) return -1;
+
+  return scan(high_pixels, image->pixels, 0,
+              (uint32_t)image->size_x * image->size_y);
+}
+
+/*
+	extreme kernels: one pass feeding both a min heap (top X) and a max heap
+	(bottom Y), each pixel read once. Same structure as the scan kernels:
+	the SIMD versions skip the blocks where no pixel is above the min heap
+	minimum nor below the max heap maximum. An empty heap (capacity 0) gets
+	nothing. Each heap sees the exact operations of its own scalar scan.
+*/
+typedef int32_t (*extreme_kernel_fn)(heap_t* high, heap_t* low,
+                                     const uint16_t* pixels, uint32_t base,
+                                     uint32_t count);
+
+/* the bottom counterpart of scan_candidate(), the heap must be full */
+static inline int32_t scan_max_candidate(heap_t* heap, uint32_t offset,
+                                         uint16_t value) {
+  STATS_ADD(candidates, 1);
+
+  if (heap->values[0] > value) {
+    STATS_ADD(replaces, 1);
+    heap_max_sift_down(heap->offsets, heap->values, heap->size, 0, offset,
+                       value);
+  }
+
+  return 0;
+}
+
+/* feeds a pixel to both heaps */
+static inline void extreme_pixel(heap_t* high, heap_t* low, uint32_t offset,
+                                 uint16_t value) {
+  if (!heap_full(high))
+    heap_min_push(high, offset, value);
+  else if (!heap_empty(high))
+    scan_candidate(high, offset, value);
+
+  if (!heap_full(low))
+    heap_max_push(low, offset, value);
+  else if (!heap_empty(low))
+    scan_max_candidate(low, offset, value);
+}
+
+static int32_t extreme_scalar(heap_t* high, heap_t* low, const uint16_t* pixels,
+                              uint32_t base, uint32_t count) {
+  STATS_ADD(scanned, count);
+
+  for (uint32_t i = 0; i < count; ++i)
+    extreme_pixel(high, low, base + i, pixels[i]);
+
+  return 0;
+}
+
+/* bounds of the SIMD filter: nothing passes for an empty heap */
+static inline uint16_t extreme_high_bound(const heap_t* high) {
+  return !heap_empty(high) ? high->values[0] : 0xffff;
+}
+
+static inline uint16_t extreme_low_bound(const heap_t* low) {
+  return !heap_empty(low) ? low->values[0] : 0;
+}
+
+/* pixels fed one by one until both heaps are full, the caller counts them */
+static inline uint32_t extreme_fill(heap_t* high, heap_t* low,
+                                    const uint16_t* pixels, uint32_t base,
+                                    uint32_t count) {
+  uint32_t i = 0;
+
+  for (; i < count && (!heap_full(high) || !heap_full(low)); ++i)
+    extreme_pixel(high, low, base + i, pixels[i]);
+
+  return i;
+}
+
+#ifdef HAVE_X86_KERNELS
+/* v > high bound iff subs(v, high) != 0, v < low bound iff subs(low, v) != 0 */
+__attribute__((target("sse4.1"))) static int32_t extreme_sse41(
+    heap_t* high, heap_t* low, const uint16_t* pixels, uint32_t base,
+    uint32_t count) {
+  uint32_t i = extreme_fill(high, low, pixels, base, count);
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(pixels + i));
+    __m128i above =
+        _mm_subs_epu16(v, _mm_set1_epi16((int16_t)extreme_high_bound(high)));
+    __m128i below =
+        _mm_subs_epu16(_mm_set1_epi16((int16_t)extreme_low_bound(low)), v);
+    __m128i any = _mm_or_si128(above, below);
+
+    if (_mm_testz_si128(any, any)) continue;
+
+    /* 2 mask bits per 16-bit lane */
+    uint32_t mask =
+        ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(any, zero)) & 0xffff;
+
+    while (mask) {
+      uint32_t j = i + (__builtin_ctz(mask) >> 1);
+      mask &= mask - 1;
+      mask &= mask - 1;
+      extreme_pixel(high, low, base + j, pixels[j]);
+    }
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return extreme_scalar(high, low, pixels + i, base + i, count - i);
+}
+
+/*
+	same as extreme_sse41() but with 32 pixels per iteration; the bounds
+	only change after a candidate so they stay in registers.
+*/
+__attribute__((target("avx2"))) static int32_t extreme_avx2(
+    heap_t* high, heap_t* low, const uint16_t* pixels, uint32_t base,
+    uint32_t count) {
+  uint32_t i = extreme_fill(high, low, pixels, base, count);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i high_bound = _mm256_set1_epi16((int16_t)extreme_high_bound(high));
+  __m256i low_bound = _mm256_set1_epi16((int16_t)extreme_low_bound(low));
+
+  for (; i + 32 <= count; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(pixels + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(pixels + i + 16));
+    __m256i any_a = _mm256_or_si256(_mm256_subs_epu16(a, high_bound),
+                                    _mm256_subs_epu16(low_bound, a));
+    __m256i any_b = _mm256_or_si256(_mm256_subs_epu16(b, high_bound),
+                                    _mm256_subs_epu16(low_bound, b));
+    __m256i any = _mm256_or_si256(any_a, any_b);
+
+    if (_mm256_testz_si256(any, any)) continue;
+
+    /* 2 mask bits per 16-bit lane */
+    uint64_t mask = ~(
+        (uint64_t)(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi16(any_a, zero)) |
+        ((uint64_t)(uint32_t)_mm256_movemask_epi8(
+             _mm256_cmpeq_epi16(any_b, zero))
+         << 32));
+
+    while (mask) {
+      uint32_t j = i + (__builtin_ctzll(mask) >> 1);
+      mask &= mask - 1;
+      mask &= mask - 1;
+      extreme_pixel(high, low, base + j, pixels[j]);
+    }
+
+    /* nothing can beat both heaps anymore, the rest counts as scanned */
+    if (extreme_high_bound(high) == 0xffff && !extreme_low_bound(low)) {
+      STATS_ADD(scanned, count);
+      return 0;
+    }
+
+    high_bound = _mm256_set1_epi16((int16_t)extreme_high_bound(high));
+    low_bound = _mm256_set1_epi16((int16_t)extreme_low_bound(low));
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return extreme_scalar(high, low, pixels + i, base + i, count - i);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static int32_t extreme_neon(heap_t* high, heap_t* low, const uint16_t* pixels,
+                            uint32_t base, uint32_t count) {
+  uint32_t i = extreme_fill(high, low, pixels, base, count);
+
+  for (; i + 8 <= count; i += 8) {
+    uint16x8_t v = vld1q_u16(pixels + i);
+    uint16x8_t above = vqsubq_u16(v, vdupq_n_u16(extreme_high_bound(high)));
+    uint16x8_t below = vqsubq_u16(vdupq_n_u16(extreme_low_bound(low)), v);
+
+    if (!vmaxvq_u16(vorrq_u16(above, below))) continue;
+
+    for (uint32_t j = i; j < i + 8; ++j)
+      extreme_pixel(high, low, base + j, pixels[j]);
+  }
+
+  /* the scalar kernel counts the rest */
+  STATS_ADD(scanned, i);
+
+  return extreme_scalar(high, low, pixels + i, base + i, count - i);
+}
+#endif
+
+/* see scan_kernel_get() */
+static extreme_kernel_fn extreme_kernel_get(scan_kernel_t kernel) {
+  switch (kernel) {
+    case SCAN_KERNEL_AUTO:
+#ifdef HAVE_X86_KERNELS
+      if (__builtin_cpu_supports("avx2")) return extreme_avx2;
+      if (__builtin_cpu_supports("sse4.1")) return extreme_sse41;
+#endif
+#ifdef HAVE_NEON_KERNEL
+      return extreme_neon;
+#endif
+      return extreme_scalar;
+    case SCAN_KERNEL_SCALAR:
+      return extreme_scalar;
+#ifdef HAVE_X86_KERNELS
+    case SCAN_KERNEL_SSE41:
+      return __builtin_cpu_supports("sse4.1") ? extreme_sse41 : NULL;
+    case SCAN_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2") ? extreme_avx2 : NULL;
+#endif
+#ifdef HAVE_NEON_KERNEL
+    case SCAN_KERNEL_NEON:
+      return extreme_neon;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+/*
+	computes in a single pass the first X high value pixels into the min
+	heap `high` and the first Y low value pixels into the max heap `low`,
+	X and Y being the heaps capacities, either of which may be 0.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_extreme_pixels_with(const image_t* image, heap_t* high,
+                                  heap_t* low, scan_kernel_t kernel) {
+  if (!image_check_valid(image) || !heap_check_valid(high) ||
+      !heap_check_valid(low) || high == low)
+    return -1;
+
+  extreme_kernel_fn extreme = extreme_kernel_get(kernel);
+
+  if (!extreme) return -1;
+
+  return extreme(high, low, image->pixels, 0,
+                 (uint32_t)image->size_x * image->size_y);
+}
+
+int32_t build_extreme_pixels(const image_t* image, heap_t* high, heap_t* low) {
+  return build_extreme_pixels_with(image, high, low, SCAN_KERNEL_AUTO);
+}
+
+/*
+	computes the first X low value pixels into the max heap, X being its
+	capacity.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_low_pixels(const image_t* image, heap_t* low_pixels) {
+  uint32_t offset;
+  uint16_t value;
+  heap_t none = {0, 0, &offset, &value};
+
+  return build_extreme_pixels(image, &none, low_pixels);
+}
+
+/*
+	Initialize a view of `rows` x `columns` pixels of the image starting at
+	(row, column).
+
+	return negative value on failure, 0 otherwise
+*/
+int32_t init_image_view(image_view_t* view, const image_t* image, uint16_t row,
+                        uint16_t column, uint16_t rows, uint16_t columns) {
+  if (!view || !image_check_valid(image) || row + rows > image->size_x ||
+      column + columns > image->size_y)
+    return -1;
+
+  view->origin = (uint32_t)row * image->size_y + column;
+  view->base = image->pixels + view->origin;
+  view->width = columns;
+  view->height = rows;
+  view->pitch = image->size_y;
+
+  return 0;
+}
+
+/* check view validity, the offsets must fit in 32 bits */
+static inline int8_t view_check_valid(const image_view_t* view) {
+  return view && view->base && view->width <= view->pitch &&
+         (!view->height ||
+          (uint64_t)view->origin + (uint64_t)(view->height - 1) * view->pitch +
+                  view->width <=
+              (uint64_t)UINT32_MAX + 1);
+}
+
+/*
+	computes the first X high value pixels of the view, row by row with the
+	scan kernels; dense views are scanned in one go.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_view(const image_view_t* view, heap_t* high_pixels) {
+  if (!view_check_valid(view) || !heap_check_valid(high_pixels)) return -1;
+
+  scan_kernel_fn scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  int32_t err = 0;
+
+  if (view->width == view->pitch)
+    return scan(high_pixels, view->base, view->origin,
+                view->width * view->height);
+
+  for (uint32_t r = 0; r < view->height && err >= 0; ++r)
+    err = scan(high_pixels, view->base + (size_t)r * view->pitch,
+               view->origin + r * view->pitch, view->width);
+
+  return err;
+}
+
+/* pixels corrected per chunk, the chunk buffer stays in L1 */
+#define FILTER_CHUNK 2048
+
+/* corrected pixel value, rounded and saturated to 16 bits */
+static inline uint16_t filter_pixel(uint16_t pixel, float gain, float offset) {
+  float v = pixel * gain + offset;
+
+  if (!(v > 0)) return 0;
+
+  return v >= UINT16_MAX ? UINT16_MAX : (uint16_t)(v + 0.5f);
+}
+
+/*
+	filter kernels: the filter_pixel() values of `count` pixels, `gain` and
+	`offset` may be NULL. The SIMD versions perform the same float
+	operations, so every kernel writes the same values.
+*/
+typedef void (*filter_kernel_fn)(uint16_t* out, const uint16_t* pixels,
+                                 const float* gain, const float* offset,
+                                 uint32_t count);
+
+static void filter_scalar(uint16_t* out, const uint16_t* pixels,
+                          const float* gain, const float* offset,
+                          uint32_t count) {
+  if (gain && offset)
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = filter_pixel(pixels[i], gain[i], offset[i]);
+  else if (gain)
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = filter_pixel(pixels[i], gain[i], 0);
+  else
+    for (uint32_t i = 0; i < count; ++i)
+      out[i] = filter_pixel(pixels[i], 1, offset[i]);
+}
+
+#ifdef HAVE_X86_KERNELS
+/* 4 corrected pixels as 32-bit lanes; max() turns a NaN into 0 */
+__attribute__((target("sse4.1"))) static inline __m128i filter_lanes_sse41(
+    __m128i pixels, const float* gain, const float* offset) {
+  __m128 v = _mm_cvtepi32_ps(pixels);
+
+  if (gain) v = _mm_mul_ps(v, _mm_loadu_ps(gain));
+  if (offset) v = _mm_add_ps(v, _mm_loadu_ps(offset));
+
+  v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(UINT16_MAX));
+
+  return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+}
+
+__attribute__((target("sse4.1"))) static void filter_sse41(
+    uint16_t* out, const uint16_t* pixels, const float* gain,
+    const float* offset, uint32_t count) {
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(pixels + i));
+    __m128i lo = filter_lanes_sse41(_mm_cvtepu16_epi32(v),
+                                    gain ? gain + i : NULL,
+                                    offset ? offset + i : NULL);
+    __m128i hi = filter_lanes_sse41(_mm_unpackhi_epi16(v, _mm_setzero_si128()),
+                                    gain ? gain + i + 4 : NULL,
+                                    offset ? offset + i + 4 : NULL);
+
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi32(lo, hi));
+  }
+
+  filter_scalar(out + i, pixels + i, gain ? gain + i : NULL,
+                offset ? offset + i : NULL, count - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i filter_lanes_avx2(
+    __m256i pixels, const float* gain, const float* offset) {
+  __m256 v = _mm256_cvtepi32_ps(pixels);
+
+  if (gain) v = _mm256_mul_ps(v, _mm256_loadu_ps(gain));
+  if (offset) v = _mm256_add_ps(v, _mm256_loadu_ps(offset));
+
+  v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                    _mm256_set1_ps(UINT16_MAX));
+
+  return _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+}
+
+__attribute__((target("avx2"))) static void filter_avx2(
+    uint16_t* out, const uint16_t* pixels, const float* gain,
+    const float* offset, uint32_t count) {
+  uint32_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(pixels + i));
+    __m256i lo = filter_lanes_avx2(
+        _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)),
+        gain ? gain + i : NULL, offset ? offset + i : NULL);
+    __m256i hi = filter_lanes_avx2(
+        _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)),
+        gain ? gain + i + 8 : NULL, offset ? offset + i + 8 : NULL);
+
+    /* packus works per 128-bit lane, the permute restores the pixel order */
+    _mm256_storeu_si256(
+        (__m256i*)(out + i),
+        _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8));
+  }
+
+  filter_scalar(out + i, pixels + i, gain ? gain + i : NULL,
+                offset ? offset + i : NULL, count - i);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+/* vmaxnmq_f32() turns a NaN into 0 */
+static inline uint32x4_t filter_lanes_neon(uint32x4_t pixels,
+                                           const float* gain,
+                                           const float* offset) {
+  float32x4_t v = vcvtq_f32_u32(pixels);
+
+  if (gain) v = vmulq_f32(v, vld1q_f32(gain));
+  if (offset) v = vaddq_f32(v, vld1q_f32(offset));
+
+  v = vminq_f32(vmaxnmq_f32(v, vdupq_n_f32(0)), vdupq_n_f32(UINT16_MAX));
+
+  return vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+}
+
+static void filter_neon(uint16_t* out, const uint16_t* pixels,
+                        const float* gain, const float* offset,
+                        uint32_t count) {
+  uint32_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    uint16x8_t v = vld1q_u16(pixels + i);
+    uint32x4_t lo = filter_lanes_neon(vmovl_u16(vget_low_u16(v)),
+                                      gain ? gain + i : NULL,
+                                      offset ? offset + i : NULL);
+    uint32x4_t hi = filter_lanes_neon(vmovl_u16(vget_high_u16(v)),
+                                      gain ? gain + i + 4 : NULL,
+                                      offset ? offset + i + 4 : NULL);
+
+    vst1q_u16(out + i, vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+  }
+
+  filter_scalar(out + i, pixels + i, gain ? gain + i : NULL,
+                offset ? offset + i : NULL, count - i);
+}
+#endif
+
+/* filter kernel counterpart of scan_kernel_get(), AVX2 for AVX-512 */
+static filter_kernel_fn filter_kernel_get(scan_kernel_t kernel) {
+  scan_kernel_fn scan = scan_kernel_get(kernel);
+
+#ifdef HAVE_X86_KERNELS
+  if (scan == scan_avx512 || scan == scan_avx2) return filter_avx2;
+  if (scan == scan_sse41) return filter_sse41;
+#endif
+#ifdef HAVE_NEON_KERNEL
+  if (scan == scan_neon) return filter_neon;
+#endif
+
+  return scan ? filter_scalar : NULL;
+}
+
+/* first pixel in [i, end) whose mask bit equals `bad`, `end` if none */
+static inline uint32_t mask_next(const uint64_t* mask, uint32_t i,
+                                 uint32_t end, int8_t bad) {
+  while (i < end) {
+    uint64_t word = (bad ? mask[i / 64] : ~mask[i / 64]) & ~0ULL << (i % 64);
+
+    if (word) {
+      uint32_t next = i / 64 * 64 + __builtin_ctzll(word);
+
+      return next < end ? next : end;
+    }
+
+    i = (i / 64 + 1) * 64;
+  }
+
+  return end;
+}
+
+/*
+	computes the first X high value pixels of the corrected frame, see
+	high_pixels_filter_t. The frame is corrected chunk by chunk right before
+	the scan kernel, and the runs of good pixels between the bad ones are
+	fed to the kernel, so the full corrected frame is never written. Without
+	gain nor offset the image pixels are scanned in place.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_filtered(const image_t* image,
+                                   const high_pixels_filter_t* filter,
+                                   heap_t* high_pixels) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  const uint64_t* mask = filter ? filter->mask : NULL;
+  const float* gain = filter ? filter->gain : NULL;
+  const float* offset = filter ? filter->offset : NULL;
+  int8_t correct = gain || offset;
+  uint32_t chunk = correct ? FILTER_CHUNK : size;
+  scan_kernel_fn scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  filter_kernel_fn correct_chunk = filter_kernel_get(SCAN_KERNEL_AUTO);
+  uint16_t buffer[FILTER_CHUNK];
+  int32_t err = 0;
+
+  for (uint32_t start = 0; start < size && err >= 0; start += chunk) {
+    uint32_t end = size - start < chunk ? size : start + chunk;
+    const uint16_t* pixels = image->pixels + start;
+
+    if (correct) {
+      correct_chunk(buffer, pixels, gain ? gain + start : NULL,
+                    offset ? offset + start : NULL, end - start);
+      pixels = buffer;
+    }
+
+    if (!mask) {
+      err = scan(high_pixels, pixels, start, end - start);
+      continue;
+    }
+
+    for (uint32_t i = mask_next(mask, start, end, 0); i < end && err >= 0;) {
+      uint32_t bad = mask_next(mask, i, end, 1);
+
+      err = scan(high_pixels, pixels + (i - start), i, bad - i);
+      i = mask_next(mask, bad, end, 0);
+    }
+  }
+
+  return err;
+}
+
+/*
+	begins a streaming scan into the provided heap.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t high_pixels_stream_begin(high_pixels_stream_t* stream,
+                                 heap_t* high_pixels) {
+  if (!stream || !heap_check_valid(high_pixels)) return -1;
+
+  stream->heap = high_pixels;
+  stream->scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  stream->offset = 0;
+
+  return 0;
+}
+
+/*
+	feeds the next `count` pixels of the image; the chunk memory can be
+	reused as soon as the call returns.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t high_pixels_stream_feed(high_pixels_stream_t* stream,
+                                const uint16_t* pixels, uint32_t count) {
+  if (!stream || !stream->heap || (!pixels && count)) return -1;
+
+  /* the offsets must fit in 32 bits */
+  if (count > UINT32_MAX - stream->offset) return -1;
+
+  int32_t err = stream->scan(stream->heap, pixels, stream->offset, count);
+
+  stream->offset += count;
+
+  return err;
+}
+
+/*
+	ends the streaming scan; the heap holds the top X pixels fed so far.
+
+	return negative value on failure, the number of fed pixels otherwise
+*/
+int64_t high_pixels_stream_finalize(high_pixels_stream_t* stream) {
+  if (!stream || !stream->heap) return -1;
+
+  stream->heap = NULL;
+
+  return stream->offset;
+}
+
+/* row band size targeted by the parallel scan, should fit in L2 */
+#define BAND_BYTES (256 * 1024)
+
+/* raises a shared threshold, never lowers it */
+static void threshold_publish(atomic_uint* threshold, uint32_t value) {
+  uint32_t current = atomic_load_explicit(threshold, memory_order_relaxed);
+
+  while (current < value &&
+         !atomic_compare_exchange_weak_explicit(threshold, &current, value,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+    ;
+}
+
+/*
+	scans a band into a heap that is one of several sharing a threshold:
+	the greatest minimum of their full heaps. A pixel below it is beaten by
+	X pixels of a single heap, so it can't make the top X of the union of
+	the heaps and is skipped; equal pixels are kept, they may still win the
+	tie. Once the threshold is above the heap minimum, the band is searched
+	with the find kernel for pixels reaching both, even while the heap fills
+	up, so the heap may end up with less than X items. The heap minimum is
+	published at the end of the band.
+
+	return negative value on failure, >= 0 otherwise
+*/
+static int32_t scan_band_shared(heap_t* heap, const uint16_t* pixels,
+                                uint32_t start, uint32_t count,
+                                scan_kernel_fn scan, find_kernel_fn find,
+                                atomic_uint* threshold) {
+  uint32_t shared = atomic_load_explicit(threshold, memory_order_relaxed);
+  int32_t err = 0;
+
+  /* X = 0: the heap is full and empty, there is no minimum to read */
+  if (!heap->capacity) {
+    STATS_ADD(scanned, count);
+    return 0;
+  }
+
+  if (heap_full(heap) ? shared <= heap->values[0] : !shared) {
+    err = scan(heap, pixels, start, count);
+  } else {
+    STATS_ADD(scanned, count);
+
+    for (uint32_t i = 0;; ++i) {
+      uint32_t low = heap_full(heap) ? heap->values[0] + 1u : 0;
+
+      if (low < shared) low = shared;
+      if (low > UINT16_MAX) break;
+
+      i += find(pixels + i, count - i, (uint16_t)low);
+
+      if (i >= count) break;
+
+      /* a push can't fail, the heap isn't full */
+      if (heap_full(heap))
+        scan_candidate(heap, start + i, pixels[i]);
+      else
+        heap_min_push(heap, start + i, pixels[i]);
+    }
+  }
+
+  if (heap_full(heap) && !heap_empty(heap))
+    threshold_publish(threshold, heap->values[0]);
+
+  return err;
+}
+
+/* parallel scan shared state */
+typedef struct {
+  const image_t* image;
+  scan_kernel_fn scan;
+  find_kernel_fn find; /* shared threshold scans only */
+  heap_t* heaps;       /* two private heaps per worker, see slices_take() */
+  uint32_t band_size;  /* pixels per band */
+  uint32_t bands;      /* bands count */
+  uint32_t workers;
+  slice_t* slices;       /* bands of every worker */
+  atomic_int err;        /* first error reported by a worker */
+  atomic_uint threshold; /* see scan_band_shared() */
+} parallel_scan_t;
+
+/*
+	a worker scans the bands of its slice, then steals bands from the other
+	slices; the bands of the slices before its own go to its second heap, so
+	each heap sees increasing offsets, as required by the scan kernels.
+*/
+static void parallel_scan_worker(void* arg, uint32_t worker) {
+  parallel_scan_t* ps = (parallel_scan_t*)arg;
+  uint32_t size = (uint32_t)ps->image->size_x * ps->image->size_y;
+  uint32_t victim = worker, band;
+
+  STATS_START(began);
+
+  while (atomic_load(&ps->err) >= 0 &&
+         (band = slices_take(ps->slices, ps->workers, worker, &victim)) !=
+             UINT32_MAX) {
+    heap_t* heap = &ps->heaps[victim < worker ? ps->workers + worker : worker];
+    uint32_t start = band * ps->band_size;
+    uint32_t count =
+        size - start < ps->band_size ? size - start : ps->band_size;
+    int32_t err =
+        ps->find ? scan_band_shared(heap, ps->image->pixels + start, start,
+                                    count, ps->scan, ps->find, &ps->threshold)
+                 : ps->scan(heap, ps->image->pixels + start, start, count);
+
+    if (err < 0) atomic_store(&ps->err, err);
+  }
+
+  STATS_PHASE(STATS_PHASE_SCAN, began);
+}
+
+/*
+	parallel scan with bands of `band_rows` rows; each worker builds private
+	heaps and the worker heaps are merged into `high_pixels` at the end. With
+	`shared` the workers prune against a shared threshold. The worker heaps
+	are the pool scratch ones unless the pool is busy.
+*/
+static int32_t build_high_pixels_bands(const image_t* image,
+                                       heap_t* high_pixels, uint32_t threads,
+                                       uint32_t band_rows, int8_t shared) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels) ||
+      !band_rows)
+    return -1;
+
+  parallel_scan_t ps;
+  uint32_t columns = image->size_y;
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  uint32_t capacity = high_pixels->capacity;
+
+  if (!size) return 0;
+
+  ps.image = image;
+  ps.scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  ps.find = shared ? find_kernel_get(SCAN_KERNEL_AUTO) : NULL;
+  ps.band_size = band_rows * columns;
+  ps.bands = (size + ps.band_size - 1) / ps.band_size;
+  ps.workers = workers_count(threads, ps.bands);
+  ps.slices = slices_init(ps.workers, ps.bands);
+  atomic_init(&ps.err, 0);
+  atomic_init(&ps.threshold, 0);
+
+  if (!ps.slices) return -1;
+
+  int8_t pooled = ps.workers > 1 && pool_acquire(ps.workers);
+  heap_arena_t local = {0, 0, NULL};
+  heap_arena_t* arena = &local;
+
+  if (pooled)
+    arena = pool_scratch(2 * ps.workers, capacity);
+  else if (init_heap_arena(&local, 2 * ps.workers, capacity))
+    arena = NULL;
+
+  int32_t err = arena ? 0 : -1;
+
+  if (!err) {
+    ps.heaps = arena->heaps;
+
+    for (uint32_t i = 0; i < 2 * ps.workers; ++i) {
+      ps.heaps[i].capacity = capacity;
+      ps.heaps[i].size = 0;
+    }
+
+    if (pooled)
+      pool_run(ps.workers, parallel_scan_worker, &ps);
+    else
+      err = run_workers(ps.workers, parallel_scan_worker, &ps);
+  }
+
+  if (!err) err = atomic_load(&ps.err);
+
+  STATS_START(began);
+
+  /* reduce the worker heaps into the caller heap */
+  for (uint32_t i = 0; !err && i < 2 * ps.workers; ++i) {
+    heap_t* heap = &ps.heaps[i];
+
+    for (uint32_t j = 0; !err && j < heap->size; ++j)
+      err = heap_min_offer(high_pixels, heap->offsets[j], heap->values[j]);
+  }
+
+  STATS_PHASE(STATS_PHASE_MERGE, began);
+
+  if (pooled) pool_release();
+
+  free_heap_arena(&local);
+  free(ps.slices);
+
+  return err;
+}
+
+/*
+	computes the first X high value pixels using `threads` workers, 0 meaning
+	one worker per online CPU. The image is split in cache-sized row bands.
+	The result is identical to the one of build_high_pixels().
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_parallel(const image_t* image, heap_t* high_pixels,
+                                   uint32_t threads) {
+  if (!image_check_valid(image) || !image->size_y) return -1;
+
+  uint32_t band_rows = BAND_BYTES / (image->size_y * sizeof(*image->pixels));
+
+  return build_high_pixels_bands(image, high_pixels, threads,
+                                 band_rows ? band_rows : 1, 0);
+}
+
+/*
+	same as build_high_pixels_parallel(), but the workers publish the
+	minimum of their heap to a shared threshold and skip the pixels below
+	it, instead of each worker accepting every pixel above its own minimum.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_parallel_shared(const image_t* image,
+                                          heap_t* high_pixels,
+                                          uint32_t threads) {
+  if (!image_check_valid(image) || !image->size_y) return -1;
+
+  uint32_t band_rows = BAND_BYTES / (image->size_y * sizeof(*image->pixels));
+
+  return build_high_pixels_bands(image, high_pixels, threads,
+                                 band_rows ? band_rows : 1, 1);
+}
+
+/*
+	partially sorts `keys` in descending order so that keys[nth] holds the
+	key it would hold if sorted, the greater keys placed before it.
+	Keys are unique so the quickselect can't degenerate on duplicates.
+*/
+static void select_nth_desc(uint64_t* keys, uint32_t count, uint32_t nth) {
+  uint32_t lo = 0;
+  uint32_t hi = count - 1;
+  uint64_t t;
+
+  while (hi > lo) {
+    /* median of three pivot, placed at hi */
+    uint32_t mid = lo + ((hi - lo) >> 1);
+
+    if (keys[mid] < keys[lo]) SWAP(keys[mid], keys[lo], t);
+    if (keys[hi] < keys[lo]) SWAP(keys[hi], keys[lo], t);
+    if (keys[mid] < keys[hi]) SWAP(keys[mid], keys[hi], t);
+
+    uint64_t pivot = keys[hi];
+    uint32_t store = lo;
+
+    for (uint32_t i = lo; i < hi; ++i)
+      if (keys[i] > pivot) {
+        SWAP(keys[i], keys[store], t);
+        store++;
+      }
+
+    SWAP(keys[store], keys[hi], t);
+
+    if (store == nth) return;
+
+    if (store < nth)
+      lo = store + 1;
+    else
+      hi = store - 1;
+  }
+}
+
+/*
+	selection engine: candidates above the current threshold are appended
+	to a buffer of 2 * X keys; when full, the buffer is partitioned so only
+	the top X keys are kept and the threshold is raised to the X-th key.
+	The existing heap items are seeded into the buffer.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_select(const image_t* image, heap_t* high_pixels) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  uint32_t keep = high_pixels->capacity;
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+
+  if (!keep) return 0;
+
+  STATS_ADD(scanned, size);
+
+  uint32_t cap = keep + (keep > 64 ? keep : 64);
+  uint64_t* keys = (uint64_t*)malloc(cap * sizeof(*keys));
+  const uint16_t* pixels = image->pixels;
+  uint64_t floor = 0; /* lowest key still accepted */
+  uint32_t count = 0;
+
+  if (!keys) return -1;
+
+  for (uint32_t i = 0; i < high_pixels->size; ++i)
+    keys[count++] = pixel_key(high_pixels->values[i], high_pixels->offsets[i]);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    /* filter on value first, the key is only needed by the candidates */
+    if (pixels[i] < pixel_key_value(floor)) continue;
+
+    uint64_t key = pixel_key(pixels[i], i);
+
+    if (key < floor) continue;
+
+    keys[count++] = key;
+
+    if (count == cap) {
+      select_nth_desc(keys, count, keep - 1);
+      count = keep;
+      floor = keys[keep - 1] + 1;
+    }
+  }
+
+  if (count > keep) {
+    select_nth_desc(keys, count, keep - 1);
+    count = keep;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    high_pixels->offsets[i] = pixel_key_offset(keys[i]);
+    high_pixels->values[i] = pixel_key_value(keys[i]);
+  }
+
+  high_pixels->size = count;
+  heap_heapify(high_pixels);
+  free(keys);
+
+  return 0;
+}
+
+/*
+	packed engine: the heap engine on a heap_key_t, so a replace costs one
+	64-bit compare and one move per level. The candidates are searched with
+	the find kernels above the heap minimum: a pixel equal to it only wins
+	the tie while its offset is lower, which for increasing offsets only
+	happens before the minimum offset, e.g. for the seeded heap items. The
+	heap array is copied back as is, the key order being the heap_t one.
+	The keys are allocated on every call, so ENGINE_AUTO doesn't pick it.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_packed(const image_t* image, heap_t* high_pixels) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  const uint16_t* pixels = image->pixels;
+  find_kernel_fn find = find_kernel_get(SCAN_KERNEL_AUTO);
+  heap_key_t heap;
+
+  if (!high_pixels->capacity) return 0;
+
+  if (init_heap_key(&heap, high_pixels->capacity)) return -1;
+
+  STATS_ADD(scanned, size);
+
+  for (uint32_t i = 0; i < high_pixels->size; ++i)
+    heap_key_push(&heap,
+                  pixel_key(high_pixels->values[i], high_pixels->offsets[i]));
+
+  uint32_t i = 0;
+
+  for (; i < size && heap.size < heap.capacity; ++i)
+    heap_key_push(&heap, pixel_key(pixels[i], i));
+
+  while (i < size) {
+    uint64_t min = heap.keys[0];
+    uint32_t low = pixel_key_value(min) + (i > pixel_key_offset(min));
+
+    if (low > UINT16_MAX) break;
+
+    i += find(pixels + i, size - i, (uint16_t)low);
+
+    if (i >= size) break;
+
+    uint64_t key = pixel_key(pixels[i], i);
+
+    STATS_ADD(candidates, 1);
+
+    if (key > min) heap_key_replace_top(&heap, key);
+
+    ++i;
+  }
+
+  for (uint32_t j = 0; j < heap.size; ++j) {
+    high_pixels->offsets[j] = pixel_key_offset(heap.keys[j]);
+    high_pixels->values[j] = pixel_key_value(heap.keys[j]);
+  }
+
+  high_pixels->size = heap.size;
+  free_heap_key(&heap);
+
+  return 0;
+}
+
+/*
+	Tiny X engine: for X <= SMALL_MAX_CAPACITY the heap makes way for a
+	descending array of pixel_key() keys, padded with zeroes, which rank below
+	any pixel. A candidate is inserted by shifting the lower keys one slot
+	down, no sift-down and no tie logic. The slots count is a compile-time
+	constant, 4, 8 or 16, so the shift unrolls into one compare and move per
+	slot, each with its own well predicted branch; the slots past X just hold
+	the next ranks. The candidates are searched with the find kernels as in
+	the packed engine. X = 1 is an argmax instead.
+*/
+#define SMALL_MAX_CAPACITY 16
+
+/* inserts `key` in the `slots` descending keys, the last one drops out */
+static inline __attribute__((always_inline)) void small_insert(
+    uint64_t* top, uint32_t slots, uint64_t key) {
+  uint32_t j = slots - 1;
+
+  for (; j > 0 && top[j - 1] < key; --j) top[j] = top[j - 1];
+
+  top[j] = key;
+}
+
+static inline __attribute__((always_inline)) int32_t small_scan(
+    const image_t* image, heap_t* high_pixels, uint32_t slots) {
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  uint32_t keep = high_pixels->capacity;
+  const uint16_t* pixels = image->pixels;
+  uint32_t* offsets = high_pixels->offsets;
+  uint16_t* values = high_pixels->values;
+  find_kernel_fn find = find_kernel_get(SCAN_KERNEL_AUTO);
+  uint64_t top[SMALL_MAX_CAPACITY] = {0};
+
+  STATS_ADD(scanned, size);
+
+  for (uint32_t j = 0; j < high_pixels->size; ++j)
+    small_insert(top, slots, pixel_key(values[j], offsets[j]));
+
+  for (uint32_t i = 0; i < size; ++i) {
+    uint64_t min = top[keep - 1];
+    uint32_t low = pixel_key_value(min) + (i > pixel_key_offset(min));
+
+    if (low > UINT16_MAX) break;
+
+    /* no kernel call while the pixels keep winning, e.g. ascending ones */
+    if (pixels[i] < low) i += find(pixels + i, size - i, (uint16_t)low);
+
+    if (i >= size) break;
+
+    uint64_t key = pixel_key(pixels[i], i);
+
+    STATS_ADD(candidates, 1);
+
+    if (key > min) small_insert(top, slots, key);
+  }
+
+  uint32_t count = 0;
+
+  while (count < keep && top[count]) ++count;
+
+  /* ascending keys make a valid min heap */
+  for (uint32_t j = 0; j < count; ++j) {
+    offsets[j] = pixel_key_offset(top[count - 1 - j]);
+    values[j] = pixel_key_value(top[count - 1 - j]);
+  }
+
+  high_pixels->size = count;
+
+  return 0;
+}
+
+static int32_t small_scan_4(const image_t* image, heap_t* high_pixels) {
+  return small_scan(image, high_pixels, 4);
+}
+
+static int32_t small_scan_8(const image_t* image, heap_t* high_pixels) {
+  return small_scan(image, high_pixels, 8);
+}
+
+static int32_t small_scan_16(const image_t* image, heap_t* high_pixels) {
+  return small_scan(image, high_pixels, 16);
+}
+
+/* pixels per argmax block, only the block holding the maximum is read twice */
+#define ARGMAX_BLOCK 4096
+
+/*
+	X = 1: the maximum of every block with the max kernels, then the first
+	pixel equal to the greatest one within the first block reaching it, so
+	the lowest offset wins the tie.
+*/
+static int32_t small_argmax(const image_t* image, heap_t* high_pixels) {
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  const uint16_t* pixels = image->pixels;
+  max_kernel_fn max = max_kernel_get(SCAN_KERNEL_AUTO);
+  find_kernel_fn find = find_kernel_get(SCAN_KERNEL_AUTO);
+  int32_t best = -1;
+  uint32_t block = 0;
+
+  STATS_ADD(scanned, size);
+
+  for (uint32_t i = 0; i < size && best < UINT16_MAX; i += ARGMAX_BLOCK) {
+    uint32_t count = size - i < ARGMAX_BLOCK ? size - i : ARGMAX_BLOCK;
+    int32_t value = max(pixels + i, count);
+
+    if (value > best) {
+      best = value;
+      block = i;
+    }
+  }
+
+  if (best < 0) return 0;
+
+  uint32_t offset = block + find(pixels + block, size - block, (uint16_t)best);
+
+  STATS_ADD(candidates, 1);
+
+  return heap_min_offer(high_pixels, offset, (uint16_t)best);
+}
+
+/*
+	computes the first X high value pixels with the tiny X kernels, the heap
+	engine taking over above SMALL_MAX_CAPACITY.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_small(const image_t* image, heap_t* high_pixels) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  uint32_t keep = high_pixels->capacity;
+
+  if (!keep) return 0;
+  if (keep == 1) return small_argmax(image, high_pixels);
+  if (keep <= 4) return small_scan_4(image, high_pixels);
+  if (keep <= 8) return small_scan_8(image, high_pixels);
+  if (keep <= 16) return small_scan_16(image, high_pixels);
+
+  return build_high_pixels_with(image, high_pixels, SCAN_KERNEL_AUTO);
+}
+
+#define HISTOGRAM_BINS 256
+
+/*
+	histogram engine, radix style:
+	  (1) a coarse histogram of the value high bytes gives the high byte of
+	      the X-th greatest value, the threshold
+	  (2) a fine histogram of the low bytes of the pixels sharing that high
+	      byte gives the threshold and how many pixels equal to it must be
+	      taken
+	  (3) the pixels above the threshold and the first pixels equal to it
+	      are collected, so ties go to the lower offsets, and heapified.
+	The 256-bin histograms stay in L1; the coarse pass uses 4 interleaved
+	histograms so runs of equal pixels don't serialize on the same counter.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_histogram(const image_t* image,
+                                    heap_t* high_pixels) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  uint32_t keep = high_pixels->capacity;
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  const uint16_t* pixels = image->pixels;
+  uint32_t* offsets = high_pixels->offsets;
+  uint16_t* values = high_pixels->values;
+  uint32_t saved = high_pixels->size;
+  uint64_t* items = NULL;
+
+  if (!keep) return 0;
+
+  STATS_ADD(scanned, size);
+
+  /* put aside the existing items, they are offered back at the end */
+  if (saved) {
+    items = (uint64_t*)malloc(saved * sizeof(*items));
+
+    if (!items) return -1;
+
+    for (uint32_t i = 0; i < saved; ++i)
+      items[i] = pixel_key(values[i], offsets[i]);
+  }
+
+  uint32_t coarse[4][HISTOGRAM_BINS] = {{0}};
+  uint32_t fine[HISTOGRAM_BINS] = {0};
+  uint32_t i = 0;
+
+  for (; i + 4 <= size; i += 4) {
+    coarse[0][pixels[i] >> 8]++;
+    coarse[1][pixels[i + 1] >> 8]++;
+    coarse[2][pixels[i + 2] >> 8]++;
+    coarse[3][pixels[i + 3] >> 8]++;
+  }
+
+  for (; i < size; ++i) coarse[0][pixels[i] >> 8]++;
+
+  for (uint32_t bin = 0; bin < HISTOGRAM_BINS; ++bin)
+    coarse[0][bin] += coarse[1][bin] + coarse[2][bin] + coarse[3][bin];
+
+  /* walk down the bins until X pixels are covered */
+  uint32_t high = HISTOGRAM_BINS - 1;
+  uint32_t above = 0; /* pixels greater than the threshold */
+
+  for (; high > 0 && above + coarse[0][high] < keep; --high)
+    above += coarse[0][high];
+
+  find_kernel_fn find = find_kernel_get(SCAN_KERNEL_AUTO);
+
+  /* only the pixels >= high << 8 are relevant from now on */
+  for (i = find(pixels, size, high << 8); i < size;
+       i += 1 + find(pixels + i + 1, size - i - 1, high << 8))
+    if ((pixels[i] >> 8) == high) fine[pixels[i] & 0xff]++;
+
+  uint32_t low = HISTOGRAM_BINS - 1;
+
+  for (; low > 0 && above + fine[low] < keep; --low) above += fine[low];
+
+  uint16_t threshold = (uint16_t)(high << 8 | low);
+  uint32_t equal = fine[low]; /* pixels equal to threshold to take */
+
+  if (above + equal > keep) equal = keep - above;
+
+  uint32_t count = 0;
+
+  for (i = find(pixels, size, threshold); i < size;
+       i += 1 + find(pixels + i + 1, size - i - 1, threshold)) {
+    uint16_t value = pixels[i];
+
+    if (value > threshold || equal) {
+      equal -= value == threshold;
+      offsets[count] = i;
+      values[count] = value;
+      count++;
+    }
+  }
+
+  high_pixels->size = count;
+  heap_heapify(high_pixels);
+
+  int32_t err = 0;
+
+  for (i = 0; i < saved && err >= 0; ++i)
+    err = heap_min_offer(high_pixels, pixel_key_offset(items[i]),
+                         pixel_key_value(items[i]));
+
+  free(items);
+
+  return err;
+}
+
+/*
+	the histogram engine, and to a lesser extent the selection engine, beat
+	the heap for X >= LARGE_MIN_CAPACITY as long as the image has less than
+	X * LARGE_MAX_RATIO pixels, see README
+*/
+#define LARGE_MIN_CAPACITY 256
+#define LARGE_MAX_RATIO 1024
+
+static engine_t engine_pick(const image_t* image, const heap_t* high_pixels) {
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+
+  /* tiny X: the sorted keys beat the heap on every distribution */
+  if (high_pixels->capacity <= SMALL_MAX_CAPACITY) return ENGINE_SMALL;
+
+  /* small X: the heap fits in L1 and hardly changes once full */
+  if (high_pixels->capacity < LARGE_MIN_CAPACITY) return ENGINE_HEAP;
+
+  /*
+      large N: the heap fills quickly and then rejects almost every pixel.
+      ENGINE_PACKED replaces faster but allocates its keys on every call,
+      and the batch, queue and pool paths rely on AUTO not allocating.
+  */
+  return size / LARGE_MAX_RATIO < high_pixels->capacity ? ENGINE_HISTOGRAM
+                                                        : ENGINE_HEAP;
+}
+
+/*
+	computes the first X high value pixels using the provided engine.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_engine(const image_t* image, heap_t* high_pixels,
+                                 engine_t engine) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return -1;
+
+  if (engine == ENGINE_AUTO) engine = engine_pick(image, high_pixels);
+
+  int32_t err = -1;
+
+  STATS_START(began);
+
+  switch (engine) {
+    case ENGINE_HEAP:
+      err = build_high_pixels_with(image, high_pixels, SCAN_KERNEL_AUTO);
+      break;
+    case ENGINE_SELECT:
+      err = build_high_pixels_select(image, high_pixels);
+      break;
+    case ENGINE_HISTOGRAM:
+      err = build_high_pixels_histogram(image, high_pixels);
+      break;
+    case ENGINE_PACKED:
+      err = build_high_pixels_packed(image, high_pixels);
+      break;
+    case ENGINE_SMALL:
+      err = build_high_pixels_small(image, high_pixels);
+      break;
+    default:
+      break;
+  }
+
+  STATS_PHASE(STATS_PHASE_BUILD, began);
+
+  return err;
+}
+
+/*
+	computes the first X high value pixels; X represents the heap size.
+
+	return negative value on failure, >= 0 otherwise
+ */
+int32_t build_high_pixels(const image_t* image, heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_AUTO);
+}
+
+/*
+	Approximate mode: a threshold t is estimated from a strided sample, a
+	radix histogram pair as in the histogram engine, then a single gather
+	pass with the find kernels collects the first X pixels >= t and counts
+	all of them, no heap maintenance. With c pixels >= t, every reported
+	pixel ranks within the first c, i.e. the rank error is at most c - X.
+	When less than X pixels reach t the exact engine takes over.
+*/
+
+/* default sampling stride: the sample is 1 / APPROX_STRIDE of the frame */
+#define APPROX_STRIDE 128
+
+/*
+	the sample is made of runs of APPROX_RUN contiguous pixels, one every
+	APPROX_RUN * stride pixels, so it only touches the sampled cache lines
+*/
+#define APPROX_RUN 64
+
+#define APPROX_SAMPLE(pixels, size, stride, v, body)                   \
+  for (uint32_t run = 0; run < (size); run += APPROX_RUN * (stride))   \
+    for (uint32_t i = run; i < run + APPROX_RUN && i < (size); ++i) { \
+      uint16_t v = (pixels)[i];                                        \
+      body;                                                            \
+    }
+
+/*
+	the sample value of rank `rank` (1 for the greatest), 0 if the sample
+	is smaller than `rank`.
+*/
+static uint16_t approx_sample_threshold(const uint16_t* pixels, uint32_t size,
+                                        uint32_t stride, uint32_t rank) {
+  uint32_t coarse[HISTOGRAM_BINS] = {0};
+  uint32_t fine[HISTOGRAM_BINS] = {0};
+  uint32_t above = 0, high, low;
+
+  APPROX_SAMPLE(pixels, size, stride, v, ++coarse[v >> 8]);
+
+  for (high = HISTOGRAM_BINS; high-- > 0 && above + coarse[high] < rank;)
+    above += coarse[high];
+
+  if (high >= HISTOGRAM_BINS) return 0;
+
+  APPROX_SAMPLE(pixels, size, stride, v, fine[v & 0xff] += v >> 8 == high);
+
+  for (low = HISTOGRAM_BINS; low-- > 0 && above + fine[low] < rank;)
+    above += fine[low];
+
+  return (uint16_t)(high << 8 | low);
+}
+
+/*
+	computes an approximation of the first X high value pixels, X being the
+	capacity of the heap, which must be empty; `stride` is the sampling
+	stride, 0 meaning APPROX_STRIDE, a smaller stride yields a tighter
+	threshold at a higher sampling cost.
+
+	return negative value on failure, the rank error bound otherwise: every
+	reported pixel is among the first X + bound pixels, 0 meaning exact.
+*/
+int64_t build_high_pixels_approx(const image_t* image, heap_t* high_pixels,
+                                 uint32_t stride) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels) ||
+      high_pixels->size)
+    return -1;
+
+  uint32_t keep = high_pixels->capacity;
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  const uint16_t* pixels = image->pixels;
+
+  if (!stride) stride = APPROX_STRIDE;
+
+  if (!keep) return 0;
+
+  /*
+      the X-th pixel is expected at rank X / stride in the sample; aim a
+      few standard deviations lower so that X pixels reach t
+  */
+  double expected = (double)keep / stride;
+  uint32_t rank = (uint32_t)(expected + 3 * sqrt(expected)) + 1;
+  uint16_t threshold = approx_sample_threshold(pixels, size, stride, rank);
+  find_kernel_fn find = find_kernel_get(SCAN_KERNEL_AUTO);
+  uint32_t count = 0;
+
+  STATS_ADD(scanned, size);
+
+  for (uint32_t i = find(pixels, size, threshold); i < size;
+       i += 1 + find(pixels + i + 1, size - i - 1, threshold)) {
+    if (count < keep) {
+      high_pixels->offsets[count] = i;
+      high_pixels->values[count] = pixels[i];
+    }
+
+    ++count;
+  }
+
+  /* the sample overestimated t, the top X may be below it */
+  if (count < keep && count < size) {
+    int32_t err = build_high_pixels_engine(image, high_pixels, ENGINE_AUTO);
+
+    return err < 0 ? err : 0;
+  }
+
+  high_pixels->size = count < keep ? count : keep;
+  heap_heapify(high_pixels);
+
+  return count - high_pixels->size;
+}
+
+/* Initialize the temporal state, the first frame takes a full pass */
+void init_high_pixels_temporal(high_pixels_temporal_t* temporal) {
+  memset(temporal, 0, sizeof(*temporal));
+}
+
+/*
+	computes the first X high value pixels of the next frame of a sequence,
+	X being the heap capacity. The heap must be empty, otherwise the frame
+	takes the regular path.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_temporal(const image_t* image, heap_t* high_pixels,
+                                   high_pixels_temporal_t* temporal) {
+  if (!image_check_valid(image) || !heap_check_valid(high_pixels) ||
+      !temporal)
+    return -1;
+
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  int32_t err = 0;
+
+  ++temporal->frames;
+
+  if (temporal->primed && !high_pixels->size) {
+    scan_kernel_fn scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+    find_kernel_fn find = find_kernel_get(SCAN_KERNEL_AUTO);
+    uint32_t band = BAND_BYTES / sizeof(*image->pixels);
+    atomic_uint threshold;
+
+    /* a single heap: its own minimum raises the threshold as it goes */
+    atomic_init(&threshold, temporal->threshold);
+
+    for (uint32_t start = 0; start < size && err >= 0; start += band)
+      err = scan_band_shared(high_pixels, image->pixels + start, start,
+                             size - start < band ? size - start : band, scan,
+                             find, &threshold);
+
+    if (err < 0) return err;
+
+    /* less than X pixels reach the threshold, the top X may be below it */
+    if (!heap_full(high_pixels)) {
+      ++temporal->misses;
+      high_pixels->size = 0;
+      err = build_high_pixels_engine(image, high_pixels, ENGINE_AUTO);
+    }
+  } else {
+    err = build_high_pixels_engine(image, high_pixels, ENGINE_AUTO);
+  }
+
+  /* the frames with less than X pixels don't give a threshold */
+  temporal->primed = err >= 0 && heap_full(high_pixels) &&
+                     !heap_empty(high_pixels);
+  temporal->threshold = temporal->primed ? heap_peek(high_pixels) : 0;
+
+  return err;
+}
+
+static void* queue_main(void* arg) {
+  high_pixels_queue_t* queue = (high_pixels_queue_t*)arg;
+
+  pthread_mutex_lock(&queue->lock);
+
+  for (;;) {
+    high_pixels_job_t* job = &queue->jobs[queue->tail];
+
+    /* the queued jobs are drained before stopping */
+    while (job->state != JOB_QUEUED && !queue->stop)
+      pthread_cond_wait(&queue->cond, &queue->lock);
+
+    if (job->state != JOB_QUEUED) break;
+
+    job->state = JOB_RUNNING;
+    queue->tail = (queue->tail + 1) % queue->depth;
+
+    pthread_mutex_unlock(&queue->lock);
+
+    int32_t status =
+        queue->threads == 1
+            ? build_high_pixels(job->image, &job->heap)
+            : build_high_pixels_parallel(job->image, &job->heap, queue->threads);
+
+    /* the callback sees the job running, it can't be reused under it */
+    job->status = status;
+
+    if (queue->done) queue->done(job, queue->user);
+
+    pthread_mutex_lock(&queue->lock);
+
+    job->state = job->released ? JOB_FREE : JOB_DONE;
+    job->released = 0;
+
+    pthread_cond_broadcast(&queue->cond);
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+  high_pixels_stats_flush();
+
+  return NULL;
+}
+
+/*
+	Initialize a queue of `depth` result heaps of the provided capacity,
+	scanned with `threads` workers (0 meaning one per online CPU); `done`
+	may be NULL.
+
+	return 0 on success, != 0 otherwise
+*/
+int32_t init_high_pixels_queue(high_pixels_queue_t* queue, uint32_t depth,
+                               uint32_t capacity, uint32_t threads,
+                               high_pixels_done_fn done, void* user) {
+  if (!queue || !depth) return -1;
+
+  memset(queue, 0, sizeof(*queue));
+  queue->jobs = (high_pixels_job_t*)calloc(depth, sizeof(*queue->jobs));
+
+  if (!queue->jobs) return -1;
+
+  uint32_t ready = 0;
+
+  for (; ready < depth; ++ready) {
+    if (init_heap(&queue->jobs[ready].heap, capacity)) break;
+
+    queue->jobs[ready].queue = queue;
+  }
+
+  queue->depth = depth;
+  queue->threads = threads;
+  queue->done = done;
+  queue->user = user;
+
+  if (ready == depth && !pthread_mutex_init(&queue->lock, NULL)) {
+    if (!pthread_cond_init(&queue->cond, NULL)) {
+      if (!pthread_create(&queue->thread, NULL, queue_main, queue)) return 0;
+
+      pthread_cond_destroy(&queue->cond);
+    }
+
+    pthread_mutex_destroy(&queue->lock);
+  }
+
+  while (ready) free_heap(&queue->jobs[--ready].heap);
+
+  free(queue->jobs);
+  queue->jobs = NULL;
+
+  return -1;
+}
+
+/*
+	queues a frame; the image must stay valid until the job completes.
+	Never blocks: when the next buffer is still queued, running or not
+	released, the frame isn't accepted.
+
+	return the job handle, NULL if all the buffers are in flight
+*/
+high_pixels_job_t* high_pixels_submit(high_pixels_queue_t* queue,
+                                      const image_t* image) {
+  if (!queue || !queue->jobs) return NULL;
+
+  pthread_mutex_lock(&queue->lock);
+
+  high_pixels_job_t* job = &queue->jobs[queue->head];
+
+  if (job->state != JOB_FREE || queue->stop) {
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+  }
+
+  job->image = image;
+  job->heap.size = 0;
+  job->status = 0;
+  job->frame = queue->submitted++;
+  job->state = JOB_QUEUED;
+  queue->head = (queue->head + 1) % queue->depth;
+
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+
+  return job;
+}
+
+/* returns 1 once the job completed, 0 otherwise */
+int8_t high_pixels_poll(high_pixels_job_t* job) {
+  pthread_mutex_lock(&job->queue->lock);
+
+  int8_t done = job->state == JOB_DONE;
+
+  pthread_mutex_unlock(&job->queue->lock);
+
+  return done;
+}
+
+/*
+	waits for the job completion.
+
+	return the job status: negative value on failure, >= 0 otherwise
+*/
+int32_t high_pixels_wait(high_pixels_job_t* job) {
+  high_pixels_queue_t* queue = job->queue;
+
+  pthread_mutex_lock(&queue->lock);
+
+  while (job->state == JOB_QUEUED || job->state == JOB_RUNNING)
+    pthread_cond_wait(&queue->cond, &queue->lock);
+
+  int32_t status = job->state == JOB_DONE ? job->status : -1;
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return status;
+}
+
+/*
+	hands a completed job buffer back to the queue; from the callback, the
+	buffer is handed back once the callback returns.
+*/
+void high_pixels_release(high_pixels_job_t* job) {
+  pthread_mutex_lock(&job->queue->lock);
+
+  if (job->state == JOB_DONE)
+    job->state = JOB_FREE;
+  else if (job->state == JOB_RUNNING)
+    job->released = 1;
+
+  pthread_mutex_unlock(&job->queue->lock);
+}
+
+/*
+	Deallocates queue resources once the queued jobs are done; the job
+	handles are invalid afterwards.
+*/
+void free_high_pixels_queue(high_pixels_queue_t* queue) {
+  if (!queue || !queue->jobs) return;
+
+  pthread_mutex_lock(&queue->lock);
+  queue->stop = 1;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+
+  pthread_join(queue->thread, NULL);
+
+  for (uint32_t i = 0; i < queue->depth; ++i) free_heap(&queue->jobs[i].heap);
+
+  pthread_cond_destroy(&queue->cond);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->jobs);
+  queue->jobs = NULL;
+}
+
+/* batch shared state */
+typedef struct {
+  const image_t* images;
+  heap_arena_t* arena;
+  uint32_t count;   /* frames count */
+  atomic_uint next; /* next frame to process */
+  atomic_int err;   /* first error reported by a worker */
+} batch_t;
+
+static void batch_worker(void* arg, uint32_t worker) {
+  batch_t* batch = (batch_t*)arg;
+
+  (void)worker;
+
+  for (uint32_t frame = atomic_fetch_add(&batch->next, 1);
+       frame < batch->count; frame = atomic_fetch_add(&batch->next, 1)) {
+    heap_t* heap = &batch->arena->heaps[frame];
+    int32_t err;
+
+    heap->size = 0;
+    err = build_high_pixels_engine(&batch->images[frame], heap, ENGINE_AUTO);
+
+    if (err < 0) atomic_store(&batch->err, err);
+  }
+}
+
+/*
+	computes the first X high value pixels of `count` frames into the arena
+	heaps, X being the arena capacity; frame i goes to arena->heaps[i] and
+	the frames are spread over `threads` workers, 0 meaning one worker per
+	online CPU. The heaps are reset first; the engines ENGINE_AUTO picks
+	don't allocate on empty heaps, so nothing is allocated per frame.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_batch(const image_t* images, uint32_t count,
+                                heap_arena_t* arena, uint32_t threads) {
+  if (!images || !arena || !arena->heaps || count > arena->frames) return -1;
+
+  batch_t batch;
+
+  batch.images = images;
+  batch.arena = arena;
+  batch.count = count;
+  atomic_init(&batch.next, 0);
+  atomic_init(&batch.err, 0);
+
+  if (!count) return 0;
+
+  int32_t err = run_workers(workers_count(threads, count), batch_worker,
+                            &batch);
+
+  return err ? err : atomic_load(&batch.err);
+}
+
+/* stack scan shared state */
+typedef struct {
+  const image_t* images;
+  heap_arena_t* arena;
+  scan_kernel_fn scan;
+  find_kernel_fn find;
+  uint32_t* sizes;       /* items per image heap, kept by the sort */
+  uint32_t count;        /* images count */
+  atomic_uint threshold; /* best full heap minimum so far */
+  atomic_uint next;      /* next image to scan */
+  atomic_int err;        /* first error reported by a worker */
+} stack_scan_t;
+
+/*
+	scans one image band by band, see scan_band_shared().
+*/
+static int32_t stack_scan_image(stack_scan_t* ss, const image_t* image,
+                                heap_t* heap) {
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  uint32_t band = BAND_BYTES / sizeof(*image->pixels);
+  int32_t err = 0;
+
+  for (uint32_t start = 0; start < size && err >= 0; start += band)
+    err = scan_band_shared(heap, image->pixels + start, start,
+                           size - start < band ? size - start : band, ss->scan,
+                           ss->find, &ss->threshold);
+
+  return err;
+}
+
+static void stack_worker(void* arg, uint32_t worker) {
+  stack_scan_t* ss = (stack_scan_t*)arg;
+
+  (void)worker;
+
+  for (uint32_t i = atomic_fetch_add(&ss->next, 1); i < ss->count;
+       i = atomic_fetch_add(&ss->next, 1)) {
+    heap_t* heap = &ss->arena->heaps[i];
+    int32_t err = image_check_valid(&ss->images[i])
+                      ? stack_scan_image(ss, &ss->images[i], heap)
+                      : -1;
+
+    if (err < 0) atomic_store(&ss->err, err);
+
+    /* pops leave the heap items sorted in descending order */
+    ss->sizes[i] = heap->size;
+
+    while (heap->size) heap_min_pop(heap);
+  }
+}
+
+/* merge order: does the head of image a rank below the head of image b */
+static inline int8_t stack_head_less(const heap_arena_t* arena,
+                                     const uint32_t* heads, uint32_t a,
+                                     uint32_t b) {
+  uint16_t value_a = arena->heaps[a].values[heads[a]];
+  uint16_t value_b = arena->heaps[b].values[heads[b]];
+
+  return value_a < value_b ||
+         (value_a == value_b &&
+          (a > b || (a == b && arena->heaps[a].offsets[heads[a]] >
+                                   arena->heaps[b].offsets[heads[b]])));
+}
+
+/* sifts the image at `parent` down the merge max heap */
+static void stack_merge_sift(const heap_arena_t* arena, const uint32_t* heads,
+                             uint32_t* merge, uint32_t size, uint32_t parent) {
+  uint32_t image = merge[parent];
+
+  for (uint32_t child = 2 * parent + 1; child < size;
+       parent = child, child = 2 * parent + 1) {
+    if (child + 1 < size &&
+        stack_head_less(arena, heads, merge[child], merge[child + 1]))
+      ++child;
+
+    if (!stack_head_less(arena, heads, image, merge[child])) break;
+
+    merge[parent] = merge[child];
+  }
+
+  merge[parent] = image;
+}
+
+/*
+	computes the first `high_num` high value pixels across `count` images
+	into `out`, in descending order, using `threads` workers, 0 meaning one
+	worker per online CPU. The per image results are combined with a k-way
+	merge.
+
+	return negative value on failure, the number of reported pixels otherwise
+*/
+int64_t build_high_pixels_stack(const image_t* images, uint32_t count,
+                                stack_pixel_t* out, uint32_t high_num,
+                                uint32_t threads) {
+  if (!images || (!out && high_num)) return -1;
+  if (!count || !high_num) return 0;
+
+  heap_arena_t arena;
+  stack_scan_t ss;
+  int64_t reported = 0;
+
+  if (init_heap_arena(&arena, count, high_num)) return -1;
+
+  /* sizes, merge heads and merge heap, one slot per image each */
+  uint32_t* sizes = (uint32_t*)malloc(3 * (size_t)count * sizeof(*sizes));
+
+  if (!sizes) {
+    free_heap_arena(&arena);
+    return -1;
+  }
+
+  ss.images = images;
+  ss.arena = &arena;
+  ss.scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  ss.find = find_kernel_get(SCAN_KERNEL_AUTO);
+  ss.sizes = sizes;
+  ss.count = count;
+  atomic_init(&ss.threshold, 0);
+  atomic_init(&ss.next, 0);
+  atomic_init(&ss.err, 0);
+
+  int32_t err = run_workers(workers_count(threads, count), stack_worker, &ss);
+
+  if (!err) err = atomic_load(&ss.err);
+
+  if (!err) {
+    uint32_t* heads = sizes + count;
+    uint32_t* merge = heads + count;
+    uint32_t size = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+      heads[i] = 0;
+
+      if (sizes[i]) merge[size++] = i;
+    }
+
+    STATS_START(began);
+
+    for (uint32_t root = size >> 1; root-- > 0;)
+      stack_merge_sift(&arena, heads, merge, size, root);
+
+    while (size && reported < high_num) {
+      uint32_t image = merge[0];
+      const heap_t* heap = &arena.heaps[image];
+      uint32_t offset = heap->offsets[heads[image]];
+      stack_pixel_t* pixel = &out[reported++];
+
+      pixel->image = image;
+      pixel->row = offset / images[image].size_y;
+      pixel->column = offset % images[image].size_y;
+      pixel->value = heap->values[heads[image]];
+
+      if (++heads[image] == sizes[image]) merge[0] = merge[--size];
+
+      stack_merge_sift(&arena, heads, merge, size, 0);
+    }
+
+    STATS_PHASE(STATS_PHASE_MERGE, began);
+  }
+
+  free(sizes);
+  free_heap_arena(&arena);
+
+  return err < 0 ? err : reported;
+}
+
+/*
+	Initialize the tile grid of a `rows` x `columns` image; the last tile of
+	a row or column may be smaller.
+
+	return 0 on success, != 0 otherwise
+*/
+int32_t init_tile_pixels(tile_pixels_t* tiles, uint16_t rows, uint16_t columns,
+                         uint16_t tile_rows, uint16_t tile_columns,
+                         uint32_t k) {
+  if (!tiles || !rows || !columns || !tile_rows || !tile_columns) return -1;
+
+  tiles->tile_rows = tile_rows;
+  tiles->tile_columns = tile_columns;
+  tiles->tiles_x = (columns + tile_columns - 1) / tile_columns;
+  tiles->tiles_y = (rows + tile_rows - 1) / tile_rows;
+
+  return init_heap_arena(&tiles->arena, tiles->tiles_x * tiles->tiles_y, k);
+}
+
+/* Deallocates tile grid resources */
+void free_tile_pixels(tile_pixels_t* tiles) {
+  if (!tiles) return;
+
+  free_heap_arena(&tiles->arena);
+}
+
+/* tiled scan shared state */
+typedef struct {
+  const image_t* image;
+  tile_pixels_t* tiles;
+  scan_kernel_fn scan;
+  atomic_uint next; /* next tile row */
+} tile_scan_t;
+
+/*
+	scans whole tile rows: every image row of the tile row is fed, segment by
+	segment, to the heaps of the tiles it crosses, in a single pass.
+*/
+static void tile_scan_worker(void* arg, uint32_t worker) {
+  tile_scan_t* ts = (tile_scan_t*)arg;
+  tile_pixels_t* tiles = ts->tiles;
+  uint32_t columns = ts->image->size_y;
+  uint32_t rows = ts->image->size_x;
+
+  (void)worker;
+
+  for (uint32_t ty = atomic_fetch_add(&ts->next, 1); ty < tiles->tiles_y;
+       ty = atomic_fetch_add(&ts->next, 1)) {
+    heap_t* heaps = tiles->arena.heaps + ty * tiles->tiles_x;
+    uint32_t end = (ty + 1) * tiles->tile_rows;
+
+    for (uint32_t tx = 0; tx < tiles->tiles_x; ++tx) heaps[tx].size = 0;
+
+    for (uint32_t row = ty * tiles->tile_rows; row < end && row < rows; ++row)
+      for (uint32_t tx = 0, col = 0; tx < tiles->tiles_x;
+           ++tx, col += tiles->tile_columns) {
+        uint32_t offset = row * columns + col;
+        uint32_t count = columns - col < tiles->tile_columns
+                             ? columns - col
+                             : tiles->tile_columns;
+
+        ts->scan(&heaps[tx], ts->image->pixels + offset, offset, count);
+      }
+  }
+}
+
+/*
+	computes the top K pixels of every tile, K being the tiles arena
+	capacity; the tile rows are spread over `threads` workers, 0 meaning one
+	worker per online CPU. Offsets are image offsets.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_tile_high_pixels(const image_t* image, tile_pixels_t* tiles,
+                               uint32_t threads) {
+  if (!image_check_valid(image) || !tiles || !tiles->arena.heaps ||
+      tiles->tiles_x !=
+          (image->size_y + tiles->tile_columns - 1) / tiles->tile_columns ||
+      tiles->tiles_y != (image->size_x + tiles->tile_rows - 1) / tiles->tile_rows)
+    return -1;
+
+  tile_scan_t ts;
+
+  ts.image = image;
+  ts.tiles = tiles;
+  ts.scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  atomic_init(&ts.next, 0);
+
+  return run_workers(workers_count(threads, tiles->tiles_y), tile_scan_worker,
+                     &ts);
+}
+
+static inline int8_t image_wide_check_valid(const image_wide_t* image) {
+  return image && image->pixels && image->rows && image->columns &&
+         image->rows <= UINT64_MAX / image->columns;
+}
+
+/*
+	Initialize a wide image with the provided distribution and seed; the
+	generator fills it as a sequence of 32-bit frames, so the ramps restart
+	every 2^31 pixels.
+
+	returns negative value on fail, 0 otherwise
+*/
+int32_t init_image_wide(image_wide_t* image, uint64_t rows, uint64_t columns,
+                        dist_t dist, uint64_t seed) {
+  if (!image || !rows || !columns || rows > SIZE_MAX / columns ||
+      rows * columns > SIZE_MAX / sizeof(*image->pixels) ||
+      dist >= DIST_COUNT)
+    return -1;
+
+  uint64_t size = rows * columns;
+
+  image->pixels = (uint16_t*)malloc((size_t)size * sizeof(*image->pixels));
+
+  if (!image->pixels) return -1;
+
+  image->rows = rows;
+  image->columns = columns;
+  image->borrowed = 0;
+
+  /* frames of up to 65535 rows of 32K pixels, the last row may be shorter */
+  for (uint64_t start = 0, frame = UINT16_MAX << 15; start < size;
+       start += frame) {
+    uint64_t count = size - start < frame ? size - start : frame;
+    image_t chunk = {image->pixels + start, (uint16_t)(count >> 15), 1 << 15,
+                     1, NULL, 0};
+    image_t tail = {image->pixels + start + (count >> 15 << 15), 1,
+                    (uint16_t)(count & 0x7fff), 1, NULL, 0};
+    uint64_t chunk_seed = seed ^ start;
+
+    if ((chunk.size_x && fill_image(&chunk, dist, chunk_seed, 0)) ||
+        (tail.size_y && fill_image(&tail, dist, ~chunk_seed, 0))) {
+      free(image->pixels);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Frees wide image object */
+void free_image_wide(image_wide_t* image) {
+  if (!image || !image->pixels || image->borrowed) return;
+
+  free(image->pixels);
+}
+
+/*
+	Initialize wide heap object with provided capacity.
+
+	return 0 on success, != 0 otherwise
+*/
+int32_t init_heap_wide(heap_wide_t* heap, uint32_t capacity) {
+  if (!heap) return -1;
+
+  /* a single allocation: the values array follows the offsets array */
+  heap->offsets = (uint64_t*)malloc(
+      capacity * (sizeof(*heap->offsets) + sizeof(*heap->values)));
+
+  if (!heap->offsets) return -1;
+
+  heap->values = (uint16_t*)(heap->offsets + capacity);
+  heap->capacity = capacity;
+  heap->size = 0;
+
+  return 0;
+}
+
+/* Deallocates wide heap resources */
+void free_heap_wide(heap_wide_t* heap) {
+  if (!heap || !heap->offsets) return;
+
+  free(heap->offsets);
+}
+
+/* same order as heap_item_less(), on 64-bit offsets */
+static inline int8_t heap_wide_item_less(uint16_t value_a, uint64_t offset_a,
+                                         uint16_t value_b, uint64_t offset_b) {
+  return (value_a < value_b) | ((value_a == value_b) & (offset_a > offset_b));
+}
+
+/* moves the item down from `parent` until it ranks below its children */
+static void heap_wide_sift_down(heap_wide_t* heap, uint32_t parent,
+                                uint64_t offset, uint16_t value) {
+  uint64_t* offsets = heap->offsets;
+  uint16_t* values = heap->values;
+
+  for (uint32_t child = 2 * parent + 1; child < heap->size;
+       parent = child, child = 2 * parent + 1) {
+    if (child + 1 < heap->size &&
+        heap_wide_item_less(values[child + 1], offsets[child + 1],
+                            values[child], offsets[child]))
+      ++child;
+
+    if (!heap_wide_item_less(values[child], offsets[child], value, offset))
+      break;
+
+    offsets[parent] = offsets[child];
+    values[parent] = values[child];
+  }
+
+  offsets[parent] = offset;
+  values[parent] = value;
+}
+
+/*
+	Offer an item to the wide heap, see heap_min_offer().
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t heap_wide_offer(heap_wide_t* heap, uint64_t offset, uint16_t value) {
+  if (!heap || !heap->offsets) return -1;
+
+  if (heap->size < heap->capacity) {
+    uint32_t child = heap->size++;
+
+    for (uint32_t parent = (child - 1) / 2;
+         child && heap_wide_item_less(value, offset, heap->values[parent],
+                                      heap->offsets[parent]);
+         child = parent, parent = (child - 1) / 2) {
+      heap->offsets[child] = heap->offsets[parent];
+      heap->values[child] = heap->values[parent];
+    }
+
+    heap->offsets[child] = offset;
+    heap->values[child] = value;
+
+    return 0;
+  }
+
+  if (!heap->size ||
+      !heap_wide_item_less(heap->values[0], heap->offsets[0], value, offset))
+    return 0;
+
+  heap_wide_sift_down(heap, 0, offset, value);
+
+  return 0;
+}
+
+/*
+	Pops the wide heap minimum into *offset and *value.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t heap_wide_pop(heap_wide_t* heap, uint64_t* offset, uint16_t* value) {
+  if (!heap || !heap->offsets || !heap->size) return -1;
+
+  *offset = heap->offsets[0];
+  *value = heap->values[0];
+
+  if (--heap->size)
+    heap_wide_sift_down(heap, 0, heap->offsets[heap->size],
+                        heap->values[heap->size]);
+
+  return 0;
+}
+
+/* pixels per wide scan chunk: 32 MB, well within the 32-bit offsets */
+#define WIDE_CHUNK ((uint64_t)1 << 24)
+
+/* wide scan shared state */
+typedef struct {
+  const image_wide_t* image;
+  scan_kernel_fn scan;
+  heap_arena_t scratch; /* 32-bit chunk heap per worker */
+  heap_wide_t* heaps;   /* private wide heap per worker */
+  uint64_t chunk;       /* pixels per chunk */
+  uint64_t chunks;      /* chunks count */
+  atomic_ullong next;   /* next chunk to scan */
+  atomic_int err;       /* first error reported by a worker */
+} wide_scan_t;
+
+/*
+	scans chunks with the 32-bit kernels, offsets relative to the chunk,
+	then widens the chunk top X into the worker wide heap.
+*/
+static void wide_scan_worker(void* arg, uint32_t worker) {
+  wide_scan_t* ws = (wide_scan_t*)arg;
+  heap_t* scratch = &ws->scratch.heaps[worker];
+  uint64_t size = ws->image->rows * ws->image->columns;
+
+  for (uint64_t chunk = atomic_fetch_add(&ws->next, 1); chunk < ws->chunks;
+       chunk = atomic_fetch_add(&ws->next, 1)) {
+    uint64_t base = chunk * ws->chunk;
+    uint64_t count = size - base < ws->chunk ? size - base : ws->chunk;
+    int32_t err;
+
+    scratch->size = 0;
+    err = ws->scan(scratch, ws->image->pixels + base, 0, (uint32_t)count);
+
+    for (uint32_t i = 0; err >= 0 && i < scratch->size; ++i)
+      err = heap_wide_offer(&ws->heaps[worker], base + scratch->offsets[i],
+                            scratch->values[i]);
+
+    if (err < 0) atomic_store(&ws->err, err);
+  }
+}
+
+static int32_t build_high_pixels_wide_chunks(const image_wide_t* image,
+                                             heap_wide_t* high_pixels,
+                                             uint32_t threads,
+                                             uint64_t chunk) {
+  wide_scan_t ws;
+  uint32_t capacity = high_pixels->capacity;
+  int32_t err = 0;
+
+  ws.image = image;
+  ws.scan = scan_kernel_get(SCAN_KERNEL_AUTO);
+  ws.chunk = chunk;
+  ws.chunks = (image->rows * image->columns + chunk - 1) / chunk;
+  atomic_init(&ws.next, 0);
+  atomic_init(&ws.err, 0);
+
+  uint32_t workers =
+      workers_count(threads, ws.chunks > UINT32_MAX ? UINT32_MAX : ws.chunks);
+
+  if (init_heap_arena(&ws.scratch, workers, capacity)) return -1;
+
+  ws.heaps = (heap_wide_t*)calloc(workers, sizeof(*ws.heaps));
+
+  for (uint32_t i = 0; ws.heaps && i < workers && !err; ++i)
+    err = init_heap_wide(&ws.heaps[i], capacity);
+
+  if (ws.heaps && !err) {
+    err = run_workers(workers, wide_scan_worker, &ws);
+
+    if (!err) err = atomic_load(&ws.err);
+
+    /* the heap order is total, the merge order doesn't matter */
+    for (uint32_t w = 0; !err && w < workers; ++w)
+      for (uint32_t i = 0; !err && i < ws.heaps[w].size; ++i)
+        err = heap_wide_offer(high_pixels, ws.heaps[w].offsets[i],
+                              ws.heaps[w].values[i]);
+  } else {
+    err = -1;
+  }
+
+  for (uint32_t i = 0; ws.heaps && i < workers; ++i)
+    free_heap_wide(&ws.heaps[i]);
+
+  free(ws.heaps);
+  free_heap_arena(&ws.scratch);
+
+  return err;
+}
+
+/*
+	computes the first X high value pixels of a wide image, X being the heap
+	capacity, using `threads` workers, 0 meaning one worker per online CPU.
+	Offsets are row * columns + column. Frames that image_t can describe
+	take the 32-bit parallel scan.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_wide(const image_wide_t* image,
+                               heap_wide_t* high_pixels, uint32_t threads) {
+  if (!image_wide_check_valid(image) || !high_pixels || !high_pixels->offsets)
+    return -1;
+
+  if (image->rows > UINT16_MAX || image->columns > UINT16_MAX)
+    return build_high_pixels_wide_chunks(image, high_pixels, threads,
+                                         WIDE_CHUNK);
+
+  image_t small = {image->pixels, (uint16_t)image->rows,
+                   (uint16_t)image->columns, 1, NULL, 0};
+  heap_t heap;
+  int32_t err;
+
+  if (init_heap(&heap, high_pixels->capacity)) return -1;
+
+  err = build_high_pixels_parallel(&small, &heap, threads);
+
+  for (uint32_t i = 0; err >= 0 && i < heap.size; ++i)
+    err = heap_wide_offer(high_pixels, heap.offsets[i], heap.values[i]);
+
+  free_heap(&heap);
+
+  return err;
+}
+
+/*
+	Pixel types: the 16-bit path above is hand tuned, the other pixel types
+	get a specialization generated from the scalar scan, with the same heap
+	layout and the same tie order. Float NaN pixels are skipped, they don't
+	compare with anything.
+*/
+#define HIGH_PIXELS_TYPED(name, type)                                         \
+  int32_t init_heap_##name(heap_##name##_t* heap, uint32_t capacity) {        \
+    if (!heap) return -1;                                                     \
+                                                                              \
+    /* a single allocation: the values array follows the offsets array */    \
+    heap->offsets = (uint32_t*)malloc(                                        \
+        capacity * (sizeof(*heap->offsets) + sizeof(*heap->values)));         \
+                                                                              \
+    if (!heap->offsets) return -1;                                            \
+                                                                              \
+    heap->values = (type*)(heap->offsets + capacity);                         \
+    heap->capacity = capacity;                                                \
+    heap->size = 0;                                                           \
+                                                                              \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  void free_heap_##name(heap_##name##_t* heap) {                              \
+    if (!heap || !heap->offsets) return;                                      \
+                                                                              \
+    free(heap->offsets);                                                      \
+  }                                                                           \
+                                                                              \
+  static inline int8_t heap_##name##_item_less(type value_a,                  \
+                                               uint32_t offset_a,             \
+                                               type value_b,                  \
+                                               uint32_t offset_b) {           \
+    return (value_a < value_b) |                                              \
+           ((value_a == value_b) & (offset_a > offset_b));                    \
+  }                                                                           \
+                                                                              \
+  static void heap_##name##_sift_down(heap_##name##_t* heap, uint32_t parent, \
+                                      uint32_t offset, type value) {          \
+    uint32_t* offsets = heap->offsets;                                        \
+    type* values = heap->values;                                              \
+                                                                              \
+    for (uint32_t child = 2 * parent + 1; child < heap->size;                 \
+         parent = child, child = 2 * parent + 1) {                            \
+      if (child + 1 < heap->size &&                                           \
+          heap_##name##_item_less(values[child + 1], offsets[child + 1],      \
+                                  values[child], offsets[child]))             \
+        ++child;                                                              \
+                                                                              \
+      if (!heap_##name##_item_less(values[child], offsets[child], value,      \
+                                   offset))                                   \
+        break;                                                                \
+                                                                              \
+      offsets[parent] = offsets[child];                                       \
+      values[parent] = values[child];                                         \
+    }                                                                         \
+                                                                              \
+    offsets[parent] = offset;                                                 \
+    values[parent] = value;                                                   \
+  }                                                                           \
+                                                                              \
+  /* see heap_min_push() */                                                  \
+  int32_t heap_##name##_push(heap_##name##_t* heap, uint32_t offset,          \
+                             type value) {                                    \
+    if (!heap || !heap->offsets || heap->size >= heap->capacity) return -1;   \
+                                                                              \
+    uint32_t child = heap->size++;                                            \
+                                                                              \
+    for (uint32_t parent = (child - 1) / 2;                                   \
+         child && heap_##name##_item_less(value, offset,                      \
+                                          heap->values[parent],               \
+                                          heap->offsets[parent]);             \
+         child = parent, parent = (child - 1) / 2) {                          \
+      heap->offsets[child] = heap->offsets[parent];                           \
+      heap->values[child] = heap->values[parent];                             \
+    }                                                                         \
+                                                                              \
+    heap->offsets[child] = offset;                                            \
+    heap->values[child] = value;                                              \
+                                                                              \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* see heap_min_pop() */                                                   \
+  int32_t heap_##name##_pop(heap_##name##_t* heap) {                          \
+    if (!heap || !heap->offsets || !heap->size) return -1;                    \
+                                                                              \
+    uint32_t offset = heap->offsets[0];                                       \
+    type value = heap->values[0];                                             \
+                                                                              \
+    if (--heap->size)                                                         \
+      heap_##name##_sift_down(heap, 0, heap->offsets[heap->size],             \
+                              heap->values[heap->size]);                      \
+                                                                              \
+    heap->offsets[heap->size] = offset;                                       \
+    heap->values[heap->size] = value;                                         \
+                                                                              \
+    return offset;                                                            \
+  }                                                                           \
+                                                                              \
+  /* see build_high_pixels(); the heap matches the scalar kernel one */      \
+  int32_t build_high_pixels_##name(const image_##name##_t* image,             \
+                                   heap_##name##_t* high_pixels) {            \
+    if (!image || !image->pixels || !high_pixels || !high_pixels->offsets)    \
+      return -1;                                                              \
+                                                                              \
+    uint32_t size = (uint32_t)image->size_x * image->size_y;                  \
+    const type* pixels = image->pixels;                                       \
+    uint32_t i = 0;                                                           \
+                                                                              \
+    for (; i < size && high_pixels->size < high_pixels->capacity; ++i)        \
+      if (pixels[i] == pixels[i])                                             \
+        heap_##name##_push(high_pixels, i, pixels[i]);                        \
+                                                                              \
+    if (!high_pixels->size) return 0;                                         \
+                                                                              \
+    for (; i < size; ++i)                                                     \
+      if (high_pixels->values[0] < pixels[i])                                 \
+        heap_##name##_sift_down(high_pixels, 0, i, pixels[i]);                \
+                                                                              \
+    return 0;                                                                 \
+  }
+
+HIGH_PIXELS_TYPED(u8, uint8_t)
+HIGH_PIXELS_TYPED(u32, uint32_t)
+HIGH_PIXELS_TYPED(f32, float)
+
+/* MIPI RAW12: 2 pixels in 3 bytes, the 8 high bits of each then the nibbles */
+static inline uint16_t raw12_pixel(const uint8_t* row, uint32_t column) {
+  const uint8_t* p = row + column / 2 * 3;
+
+  return (uint16_t)(p[column & 1] << 4) | ((p[2] >> ((column & 1) << 2)) & 0xf);
+}
+
+/*
+	computes the first X high value pixels of a MIPI RAW12 frame straight
+	from the packed data, no conversion pass: once the heap is full a pixel
+	pair is skipped when both high bytes are below the high byte of the
+	heap minimum, only the others are unpacked. The heap matches the scalar
+	kernel one on the unpacked frame; rows are `stride` bytes apart.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_raw12(const uint8_t* data, size_t stride,
+                                uint16_t rows, uint16_t columns,
+                                heap_t* high_pixels) {
+  if (!data || !heap_check_valid(high_pixels) ||
+      stride < (columns + 1) / 2 * 3)
+    return -1;
+
+  for (uint32_t row = 0; row < rows; ++row) {
+    const uint8_t* p = data + row * stride;
+    uint32_t base = row * columns;
+    uint32_t column = 0;
+
+    for (; column < columns && !heap_full(high_pixels); ++column)
+      heap_min_push(high_pixels, base + column, raw12_pixel(p, column));
+
+    if (heap_empty(high_pixels)) return 0;
+
+    /* realign on a pixel pair */
+    if ((column & 1) && column < columns) {
+      scan_candidate(high_pixels, base + column, raw12_pixel(p, column));
+      ++column;
+    }
+
+    for (; column + 1 < columns; column += 2) {
+      const uint8_t* q = p + column / 2 * 3;
+      uint8_t high = high_pixels->values[0] >> 4;
+
+      /* a pixel with a lower high byte is lower than the heap minimum */
+      if (q[0] < high && q[1] < high) continue;
+
+      scan_candidate(high_pixels, base + column,
+                     (uint16_t)(q[0] << 4) | (q[2] & 0xf));
+      scan_candidate(high_pixels, base + column + 1,
+                     (uint16_t)(q[1] << 4) | (q[2] >> 4));
+    }
+
+    if (column < columns)
+      scan_candidate(high_pixels, base + column, raw12_pixel(p, column));
+  }
+
+  return 0;
+}
+
+#ifdef HIGH_PIXEL_GPU
+/* CUDA backend, see gpu.cu */
+int32_t gpu_high_pixels(const uint16_t* pixels, uint32_t count,
+                        uint32_t high_num, uint32_t* offsets, uint16_t* values,
+                        uint32_t* size);
+int32_t gpu_upload_pixels(const uint16_t* pixels, uint32_t count,
+                          uint16_t** device);
+void gpu_free_pixels(uint16_t* device);
+
+/*
+	computes the first X high value pixels of a `rows` x `columns` frame in
+	device memory, X being the heap capacity; only the X pairs are copied
+	back, into the heap. The heap must be empty.
+
+	return negative value on failure, >= 0 otherwise
+*/
+int32_t build_high_pixels_gpu(const uint16_t* device_pixels, uint16_t rows,
+                              uint16_t columns, heap_t* high_pixels) {
+  if (!device_pixels || !heap_check_valid(high_pixels) || high_pixels->size)
+    return -1;
+
+  uint32_t size;
+  int32_t err = gpu_high_pixels(device_pixels, (uint32_t)rows * columns,
+                                high_pixels->capacity, high_pixels->offsets,
+                                high_pixels->values, &size);
+
+  if (err < 0) return err;
+
+  high_pixels->size = size;
+  heap_heapify(high_pixels);
+
+  return 0;
+}
+#endif
+
@@ -0,0 +1,536 @@
+/*
+	libhighpixel: top X high value pixels of 16-bit images, see README.md.
+
+	Every function returning an int32_t or an int64_t reports a failure with
+	a negative value. Symbols not declared here are internal: the shared
+	library hides them.
+*/
+#ifndef HIGHPIXEL_H
+#define HIGHPIXEL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* API version: the minor grows with additions, the major on breaks */
+#define HIGH_PIXEL_VERSION_MAJOR 2
+#define HIGH_PIXEL_VERSION_MINOR 0
+
+#if defined(__GNUC__)
+#define HIGH_PIXEL_API __attribute__((visibility("default")))
+#else
+#define HIGH_PIXEL_API
+#endif
+
+/* time phases of the stats */
+typedef enum {
+  STATS_PHASE_BUILD,   /* build_high_pixels_engine() calls */
+  STATS_PHASE_SCAN,    /* parallel workers scans */
+  STATS_PHASE_MERGE,   /* worker or per image heaps merges */
+  STATS_PHASE_EXTRACT, /* result extractions */
+  STATS_PHASE_COUNT
+} stats_phase_t;
+
+/* sift depth histogram buckets, the last one for the deeper sifts */
+#define STATS_SIFT_DEPTHS 24
+
+/*
+	Hot path counters, compiled in with -DHIGH_PIXEL_STATS only; otherwise
+	the STATS_* macros expand to nothing. The counters are per thread: the
+	worker threads flush theirs to the shared totals when done, other
+	threads call high_pixels_stats_flush().
+*/
+typedef struct {
+  uint64_t scanned;    /* pixels fed to the scan and find kernels */
+  uint64_t candidates; /* pixels passing the kernel filter */
+  uint64_t pushes;     /* heap_min_push() */
+  uint64_t pops;       /* heap_min_pop() */
+  uint64_t replaces;   /* heap top replacements */
+  uint64_t sift_depth[STATS_SIFT_DEPTHS]; /* sift downs per levels moved */
+  uint64_t ns[STATS_PHASE_COUNT];         /* time spent per phase */
+} high_pixels_stats_t;
+
+/* Image object type */
+typedef struct {
+  uint16_t* pixels; /* pixel array with size = size_x * size_y*/
+  /* fits most image use cases */
+  uint16_t size_x; /* image rows count */
+  uint16_t size_y; /* image columns */
+  /*
+      pixels borrowed from a read only file mapping, see load_image(): they
+      must not be written, fill_image() rejects the images with a map_base
+  */
+  uint8_t borrowed;  /* pixels are not owned, free_image() won't free them */
+  void* map_base;    /* file mapping start, NULL if none */
+  size_t map_length; /* file mapping length */
+} image_t;
+
+/* Integer heap type */
+typedef struct {
+  uint32_t capacity; /* heap max capacity */
+  uint32_t size;     /* current heap size */
+  uint32_t* offsets; /* holds pixel index */
+  uint16_t* values;  /* holds value or pixel value */
+
+  /* use separate arrays for index and value in order to
+     take advantage of data locality (cache usage) and
+     allocate less memory than putting them in a structure due to padding:
+	 E.g.
+     struct {
+		uint32_t offsets;
+        uint16_t values;
+     } items[10];
+
+    uint32_t offsets[10];
+	uint16_t values[10];
+
+	sizeof(items) > sizeof(offsets) + sizeof(values)
+
+	heap_key_t is the packed alternative, `bench --layout` compares both.
+*/
+} heap_t;
+
+/*
+	Heap arena: one heap per frame, all of them carved out of a single
+	allocation split in slabs: the heap objects, then the offsets of all the
+	frames, then the values of all the frames.
+*/
+typedef struct {
+  uint32_t frames;   /* heaps count */
+  uint32_t capacity; /* capacity of every heap */
+  heap_t* heaps;     /* heap per frame, also the allocation start */
+} heap_arena_t;
+
+/* pixel distributions generated by fill_image() */
+typedef enum {
+  DIST_UNIFORM = 0, /* uniform 16-bit */
+  DIST_UNIFORM8,    /* uniform 8-bit, lots of ties */
+  DIST_ASCENDING,   /* sorted ascending, every pixel beats the heap */
+  DIST_DESCENDING,  /* sorted descending, the heap never changes once full */
+  DIST_CONSTANT,    /* constant with rare random spikes */
+  DIST_HEAVY_TAIL,  /* Pareto like, few very bright pixels */
+  DIST_COUNT
+} dist_t;
+
+/*
+	Packed heap: the interleaved alternative to the heap_t arrays, one
+	pixel_key() per item. The 48 significant key bits hold the value above
+	the offset complement, so a single 64-bit compare orders both and the
+	sift-downs have no tie logic. Items take 8 bytes instead of 6, but a
+	sift-down step touches one array instead of two.
+*/
+typedef struct {
+  uint32_t capacity;
+  uint32_t size;
+  uint64_t* keys; /* cache line aligned */
+} heap_key_t;
+
+/*
+	scan kernels: feed `count` pixels, the first one located at offset `base`,
+	into the heap. All kernels perform the exact same sequence of heap
+	operations as the scalar one; the SIMD versions only skip, in bulk,
+	the pixels that can't beat the heap minimum once the heap is full.
+
+	return negative value on failure, >= 0 otherwise
+*/
+typedef int32_t (*scan_kernel_fn)(heap_t* heap, const uint16_t* pixels,
+                                  uint32_t base, uint32_t count);
+
+/* available scan kernels; SCAN_KERNEL_AUTO picks the best one at runtime */
+typedef enum {
+  SCAN_KERNEL_AUTO = 0,
+  SCAN_KERNEL_SCALAR,
+  SCAN_KERNEL_SSE41,
+  SCAN_KERNEL_AVX2,
+  SCAN_KERNEL_AVX512, /* AVX-512BW */
+  SCAN_KERNEL_NEON,
+  SCAN_KERNEL_COUNT
+} scan_kernel_t;
+
+/*
+	Strided image view: a rectangle within a larger pixel buffer, e.g. a
+	sensor ROI, an image without its masked borders or a pitch aligned
+	buffer. The reported offsets are source offsets: origin + row * pitch +
+	column, so the source (row, column) is (offset / pitch, offset % pitch).
+*/
+typedef struct {
+  const uint16_t* base; /* first pixel of the view */
+  uint32_t width;       /* view columns */
+  uint32_t height;      /* view rows */
+  uint32_t pitch;       /* pixels between two consecutive rows, >= width */
+  uint32_t origin;      /* source offset of the first pixel */
+} image_view_t;
+
+/*
+	Frame correction applied while ranking: the pixels with their bit set in
+	`mask` (bit i % 64 of mask[i / 64] for pixel i, e.g. a bad pixel map) are
+	never reported, and the others are ranked by their flat-field corrected
+	value, pixel * gain[i] + offset[i], rounded and saturated to 16 bits.
+	Any of the arrays may be NULL: no mask, a gain of 1, an offset of 0.
+*/
+typedef struct {
+  const uint64_t* mask; /* (N + 63) / 64 words, set bits for excluded pixels */
+  const float* gain;    /* N per pixel gains */
+  const float* offset;  /* N per pixel offsets, added after the gain */
+} high_pixels_filter_t;
+
+/*
+	Streaming scan state: the image is fed in arbitrary chunks of pixels,
+	e.g. rows as they are delivered by the capture device, in scan order.
+*/
+typedef struct {
+  heap_t* heap;        /* result heap */
+  scan_kernel_fn scan; /* scan kernel */
+  uint32_t offset;     /* offset of the next pixel to be fed */
+} high_pixels_stream_t;
+
+/* top-X engines; ENGINE_AUTO picks one based on X against N */
+typedef enum {
+  ENGINE_AUTO = 0,
+  ENGINE_HEAP,   /* min heap with SIMD pre-filter */
+  ENGINE_SELECT,    /* candidate buffer with quickselect */
+  ENGINE_HISTOGRAM, /* 16-bit value histogram, two passes */
+  ENGINE_PACKED,    /* min heap of packed 64-bit keys */
+  ENGINE_SMALL,     /* sorted keys for X <= 16, argmax for X = 1 */
+  ENGINE_COUNT
+} engine_t;
+
+/*
+	Temporal mode: consecutive video frames have nearly the same intensity
+	distribution, so the previous frame heap minimum is a good speculative
+	threshold. The first pass only collects the pixels reaching it; if X of
+	them survive the top X is exact, otherwise a full pass follows.
+*/
+typedef struct {
+  uint16_t threshold; /* previous frame heap minimum */
+  uint8_t primed;     /* the threshold comes from a previous frame */
+  uint64_t frames;    /* frames built */
+  uint64_t misses;    /* frames that needed the full pass */
+} high_pixels_temporal_t;
+
+/*
+	Submit/complete queue for pipelined capture: frames are queued to a scan
+	thread and their top X lands in one of `depth` result heaps, double or
+	triple buffering, so the capture thread never waits for a scan. The scan
+	thread runs the jobs in submission order, on the worker pool when
+	`threads` != 1. A job completes with the build status: the optional
+	callback fires from the scan thread, then the job can be polled or
+	waited for. Its heap belongs to the caller until high_pixels_release().
+*/
+typedef enum {
+  JOB_FREE = 0, /* buffer available to high_pixels_submit() */
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE /* result ready, until released */
+} job_state_t;
+
+struct high_pixels_queue;
+
+typedef struct {
+  struct high_pixels_queue* queue;
+  const image_t* image;
+  heap_t heap;     /* top X of the image once done */
+  int32_t status;  /* build result once done, negative on failure */
+  uint64_t frame;  /* submission number */
+  job_state_t state;
+  int8_t released; /* released from the callback */
+} high_pixels_job_t;
+
+/* completion callback, called from the scan thread */
+typedef void (*high_pixels_done_fn)(high_pixels_job_t* job, void* user);
+
+typedef struct high_pixels_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t cond; /* a job was queued or completed */
+  pthread_t thread;
+  high_pixels_job_t* jobs; /* ring of `depth` buffers */
+  uint32_t depth;
+  uint32_t head; /* next buffer to submit */
+  uint32_t tail; /* next buffer to scan */
+  uint32_t threads;
+  uint64_t submitted;
+  int8_t stop;
+  high_pixels_done_fn done;
+  void* user;
+} high_pixels_queue_t;
+
+/*
+	Image stacks: the top X pixels across M images. Every image is scanned
+	into its own heap, the workers publishing the minimum of their full
+	heaps as a global threshold: a pixel below it is beaten by X pixels of
+	one image and can't make the stack top X, so the scans skip it. Equal
+	pixels are kept, they may still win the tie. For equal values the lower
+	image id then the lower offset ranks higher.
+*/
+typedef struct {
+  uint32_t image;  /* image index in the stack */
+  uint16_t row;    /* pixel row */
+  uint16_t column; /* pixel column */
+  uint16_t value;  /* pixel value */
+} stack_pixel_t;
+
+/*
+	Per tile top K: the image is split in a grid of tiles and every tile
+	keeps its own top K pixels, so the hotspots are spread over the frame.
+	The tile heaps come from an arena, in row-major tile order, so the heaps
+	of a tile row are contiguous: with K = 8 a heap takes 48 bytes and the
+	heaps of a 16K pixels wide row of 64 pixels tiles fit in L1.
+*/
+typedef struct {
+  uint16_t tile_rows;    /* tile height in pixels */
+  uint16_t tile_columns; /* tile width in pixels */
+  uint32_t tiles_x;      /* tiles per tile row */
+  uint32_t tiles_y;      /* tile rows */
+  heap_arena_t arena;    /* heap of tile (tx, ty) is heaps[ty * tiles_x + tx] */
+} tile_pixels_t;
+
+/*
+	Wide geometry: stitched mosaics exceed the 16-bit sizes and the 32-bit
+	offsets of image_t and heap_t. The wide image and heap use 64-bit sizes
+	and offsets, while the pixels are still scanned by the 32-bit kernels,
+	chunk by chunk, so the hot loop is the same as for the small frames.
+*/
+typedef struct {
+  uint16_t* pixels; /* pixel array with size = rows * columns */
+  uint64_t rows;    /* image rows count */
+  uint64_t columns; /* image columns */
+  uint8_t borrowed; /* pixels are not owned, free_image_wide() won't free them */
+} image_wide_t;
+
+/* Integer heap type with 64-bit offsets */
+typedef struct {
+  uint32_t capacity; /* heap max capacity */
+  uint32_t size;     /* current heap size */
+  uint64_t* offsets; /* holds pixel index */
+  uint16_t* values;  /* holds pixel value */
+} heap_wide_t;
+
+/* images */
+HIGH_PIXEL_API int32_t init_image(image_t* image, uint16_t x, uint16_t y);
+HIGH_PIXEL_API int32_t init_image_ex(image_t* image, uint16_t x, uint16_t y,
+                                     dist_t dist, uint64_t seed);
+HIGH_PIXEL_API int32_t fill_image(image_t* image, dist_t dist, uint64_t seed,
+                                  uint32_t threads);
+HIGH_PIXEL_API void free_image(image_t* image);
+HIGH_PIXEL_API int32_t load_image(image_t* image, const char* path);
+HIGH_PIXEL_API int32_t load_image_raw(image_t* image, const char* path,
+                                      uint16_t x, uint16_t y);
+
+/* heaps */
+HIGH_PIXEL_API int32_t init_heap(heap_t* heap, uint32_t capacity);
+HIGH_PIXEL_API void free_heap(heap_t* heap);
+HIGH_PIXEL_API int32_t heap_min_push(heap_t* heap, uint32_t offset,
+                                     uint16_t value);
+HIGH_PIXEL_API int32_t heap_min_pop(heap_t* heap);
+HIGH_PIXEL_API int32_t heap_min_replace_top(heap_t* heap, uint32_t offset,
+                                            uint16_t value, uint32_t* replaced);
+HIGH_PIXEL_API int32_t heap_min_offer(heap_t* heap, uint32_t offset,
+                                      uint16_t value);
+HIGH_PIXEL_API void heap_heapify(heap_t* heap);
+HIGH_PIXEL_API int32_t heap_min_child_for_parent(const heap_t* heap,
+                                                 uint32_t parent);
+HIGH_PIXEL_API int32_t heap_max_push(heap_t* heap, uint32_t offset,
+                                     uint16_t value);
+HIGH_PIXEL_API int32_t heap_max_pop(heap_t* heap);
+HIGH_PIXEL_API int32_t heap_max_replace_top(heap_t* heap, uint32_t offset,
+                                            uint16_t value, uint32_t* replaced);
+HIGH_PIXEL_API void heap_print(const heap_t* heap, uint16_t columns);
+HIGH_PIXEL_API int32_t init_heap_key(heap_key_t* heap, uint32_t capacity);
+HIGH_PIXEL_API void free_heap_key(heap_key_t* heap);
+HIGH_PIXEL_API int32_t init_heap_arena(heap_arena_t* arena, uint32_t frames,
+                                       uint32_t capacity);
+HIGH_PIXEL_API void free_heap_arena(heap_arena_t* arena);
+
+/* top X engines */
+HIGH_PIXEL_API int32_t build_high_pixels(const image_t* image,
+                                         heap_t* high_pixels);
+HIGH_PIXEL_API int32_t build_high_pixels_engine(const image_t* image,
+                                                heap_t* high_pixels,
+                                                engine_t engine);
+HIGH_PIXEL_API int32_t build_high_pixels_with(const image_t* image,
+                                              heap_t* high_pixels,
+                                              scan_kernel_t kernel);
+HIGH_PIXEL_API int32_t build_high_pixels_select(const image_t* image,
+                                                heap_t* high_pixels);
+HIGH_PIXEL_API int32_t build_high_pixels_histogram(const image_t* image,
+                                                   heap_t* high_pixels);
+HIGH_PIXEL_API int32_t build_high_pixels_packed(const image_t* image,
+                                                heap_t* high_pixels);
+HIGH_PIXEL_API int32_t build_high_pixels_small(const image_t* image,
+                                               heap_t* high_pixels);
+HIGH_PIXEL_API int64_t build_high_pixels_approx(const image_t* image,
+                                                heap_t* high_pixels,
+                                                uint32_t stride);
+HIGH_PIXEL_API int32_t build_extreme_pixels(const image_t* image, heap_t* high,
+                                            heap_t* low);
+HIGH_PIXEL_API int32_t build_extreme_pixels_with(const image_t* image,
+                                                 heap_t* high, heap_t* low,
+                                                 scan_kernel_t kernel);
+HIGH_PIXEL_API int32_t build_low_pixels(const image_t* image,
+                                        heap_t* low_pixels);
+
+/* ranked results */
+HIGH_PIXEL_API int64_t high_pixels_extract(const heap_t* heap, uint16_t columns,
+                                           uint16_t* rows, uint16_t* cols,
+                                           uint16_t* values);
+HIGH_PIXEL_API int64_t high_pixels_extract_sorted(const heap_t* heap,
+                                                  uint16_t columns,
+                                                  uint16_t* rows,
+                                                  uint16_t* cols,
+                                                  uint16_t* values);
+
+/* parallel builds and the worker pool */
+HIGH_PIXEL_API int32_t build_high_pixels_parallel(const image_t* image,
+                                                  heap_t* high_pixels,
+                                                  uint32_t threads);
+HIGH_PIXEL_API int32_t build_high_pixels_parallel_shared(const image_t* image,
+                                                         heap_t* high_pixels,
+                                                         uint32_t threads);
+HIGH_PIXEL_API int32_t high_pixels_pool_start(uint32_t threads);
+HIGH_PIXEL_API void high_pixels_pool_stop(void);
+
+/* views, streams and video */
+HIGH_PIXEL_API int32_t init_image_view(image_view_t* view, const image_t* image,
+                                       uint16_t row, uint16_t column,
+                                       uint16_t rows, uint16_t columns);
+HIGH_PIXEL_API int32_t build_high_pixels_view(const image_view_t* view,
+                                              heap_t* high_pixels);
+HIGH_PIXEL_API int32_t high_pixels_stream_begin(high_pixels_stream_t* stream,
+                                                heap_t* high_pixels);
+HIGH_PIXEL_API int32_t high_pixels_stream_feed(high_pixels_stream_t* stream,
+                                               const uint16_t* pixels,
+                                               uint32_t count);
+HIGH_PIXEL_API int64_t high_pixels_stream_finalize(
+    high_pixels_stream_t* stream);
+HIGH_PIXEL_API void init_high_pixels_temporal(high_pixels_temporal_t* temporal);
+HIGH_PIXEL_API int32_t build_high_pixels_temporal(
+    const image_t* image, heap_t* high_pixels,
+    high_pixels_temporal_t* temporal);
+
+/* corrected frames */
+HIGH_PIXEL_API int32_t build_high_pixels_filtered(
+    const image_t* image, const high_pixels_filter_t* filter,
+    heap_t* high_pixels);
+
+/* pipelined capture */
+HIGH_PIXEL_API int32_t init_high_pixels_queue(high_pixels_queue_t* queue,
+                                              uint32_t depth, uint32_t capacity,
+                                              uint32_t threads,
+                                              high_pixels_done_fn done,
+                                              void* user);
+HIGH_PIXEL_API high_pixels_job_t* high_pixels_submit(
+    high_pixels_queue_t* queue, const image_t* image);
+HIGH_PIXEL_API int8_t high_pixels_poll(high_pixels_job_t* job);
+HIGH_PIXEL_API int32_t high_pixels_wait(high_pixels_job_t* job);
+HIGH_PIXEL_API void high_pixels_release(high_pixels_job_t* job);
+HIGH_PIXEL_API void free_high_pixels_queue(high_pixels_queue_t* queue);
+
+/* batches, stacks and tiles */
+HIGH_PIXEL_API int32_t build_high_pixels_batch(const image_t* images,
+                                               uint32_t count,
+                                               heap_arena_t* arena,
+                                               uint32_t threads);
+HIGH_PIXEL_API int64_t build_high_pixels_stack(const image_t* images,
+                                               uint32_t count,
+                                               stack_pixel_t* out,
+                                               uint32_t high_num,
+                                               uint32_t threads);
+HIGH_PIXEL_API int32_t init_tile_pixels(tile_pixels_t* tiles, uint16_t rows,
+                                        uint16_t columns, uint16_t tile_rows,
+                                        uint16_t tile_columns, uint32_t k);
+HIGH_PIXEL_API void free_tile_pixels(tile_pixels_t* tiles);
+HIGH_PIXEL_API int32_t build_tile_high_pixels(const image_t* image,
+                                              tile_pixels_t* tiles,
+                                              uint32_t threads);
+
+/* wide images */
+HIGH_PIXEL_API int32_t init_image_wide(image_wide_t* image, uint64_t rows,
+                                       uint64_t columns, dist_t dist,
+                                       uint64_t seed);
+HIGH_PIXEL_API void free_image_wide(image_wide_t* image);
+HIGH_PIXEL_API int32_t init_heap_wide(heap_wide_t* heap, uint32_t capacity);
+HIGH_PIXEL_API void free_heap_wide(heap_wide_t* heap);
+HIGH_PIXEL_API int32_t heap_wide_offer(heap_wide_t* heap, uint64_t offset,
+                                       uint16_t value);
+HIGH_PIXEL_API int32_t heap_wide_pop(heap_wide_t* heap, uint64_t* offset,
+                                     uint16_t* value);
+HIGH_PIXEL_API int32_t build_high_pixels_wide(const image_wide_t* image,
+                                              heap_wide_t* high_pixels,
+                                              uint32_t threads);
+
+/* packed RAW12 frames */
+HIGH_PIXEL_API int32_t build_high_pixels_raw12(const uint8_t* data,
+                                               size_t stride, uint16_t rows,
+                                               uint16_t columns,
+                                               heap_t* high_pixels);
+
+/* hot path stats, see HIGH_PIXEL_STATS */
+HIGH_PIXEL_API void high_pixels_stats_flush(void);
+HIGH_PIXEL_API void high_pixels_stats_get(high_pixels_stats_t* stats);
+HIGH_PIXEL_API void high_pixels_stats_reset(void);
+
+#ifdef HIGH_PIXEL_GPU
+/* CUDA backend, see gpu.cu */
+HIGH_PIXEL_API int32_t build_high_pixels_gpu(const uint16_t* device_pixels,
+                                             uint16_t rows, uint16_t columns,
+                                             heap_t* high_pixels);
+#endif
+
+/*
+	Pixel types: image and heap types plus the build for each of the 8-bit,
+	32-bit and float pixels; the 16-bit ones are image_t and heap_t.
+*/
+#define HIGH_PIXELS_TYPED_DECLARE(name, type)                                 \
+  typedef struct {                                                            \
+    type* pixels;    /* pixel array with size = size_x * size_y */            \
+    uint16_t size_x; /* image rows count */                                   \
+    uint16_t size_y; /* image columns */                                      \
+  } image_##name##_t;                                                         \
+                                                                              \
+  typedef struct {                                                            \
+    uint32_t capacity; /* heap max capacity */                                \
+    uint32_t size;     /* current heap size */                                \
+    uint32_t* offsets; /* holds pixel index */                                \
+    type* values;      /* holds pixel value */                                \
+  } heap_##name##_t;                                                          \
+                                                                              \
+  HIGH_PIXEL_API int32_t init_heap_##name(heap_##name##_t* heap,              \
+                                          uint32_t capacity);                 \
+  HIGH_PIXEL_API void free_heap_##name(heap_##name##_t* heap);                \
+  HIGH_PIXEL_API int32_t heap_##name##_push(heap_##name##_t* heap,            \
+                                            uint32_t offset, type value);     \
+  HIGH_PIXEL_API int32_t heap_##name##_pop(heap_##name##_t* heap);            \
+  HIGH_PIXEL_API int32_t build_high_pixels_##name(                            \
+      const image_##name##_t* image, heap_##name##_t* high_pixels);
+
+HIGH_PIXELS_TYPED_DECLARE(u8, uint8_t)
+HIGH_PIXELS_TYPED_DECLARE(u32, uint32_t)
+HIGH_PIXELS_TYPED_DECLARE(f32, float)
+
+/* 16-bit entry point with the same signature as the generated ones */
+static inline int32_t build_high_pixels_u16(const image_t* image,
+                                            heap_t* high_pixels) {
+  return build_high_pixels_engine(image, high_pixels, ENGINE_AUTO);
+}
+
+/* picks the build for the image pixel type */
+#define build_high_pixels_typed(image, high_pixels) \
+  _Generic((image),                                 \
+      image_t*: build_high_pixels_u16,              \
+      const image_t*: build_high_pixels_u16,        \
+      image_u8_t*: build_high_pixels_u8,            \
+      const image_u8_t*: build_high_pixels_u8,      \
+      image_u32_t*: build_high_pixels_u32,          \
+      const image_u32_t*: build_high_pixels_u32,    \
+      image_f32_t*: build_high_pixels_f32,          \
+      const image_f32_t*: build_high_pixels_f32)(image, high_pixels)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HIGHPIXEL_H */
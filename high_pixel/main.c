@@ -1,28 +1,37 @@
-#include <stdint.h>
-#include <stdio.h>
+/*
+	Tests: white-box, the library source is built in so the tests also cover
+	its internal kernels and helpers.
+*/
+#define _GNU_SOURCE /* before any system header, see highpixel.c */
+
+#include <stdatomic.h>
 #include <stdlib.h>
-#include <time.h>
 
-/*
-   Problem: get top 50 high value pixels from an image with N pixels, where
-   N = row x columns.
+/* allocations of the library, and of the tests, for the no-allocation paths */
+static atomic_uint test_allocations;
 
-   Assumptions:
-        (1) the image is provided as contiguous block of 16-bit values
-        (2) the image pixel count is less than 65536 * 65536
-        (3) all index are zero based
+static void* test_malloc(size_t size) {
+  atomic_fetch_add(&test_allocations, 1);
+  return malloc(size);
+}
 
-   Chosen solution: use a min heap to hold the highest X values and their
-   positions (offset within the block). The algorithm is implemented in
-   build_high_pixels() function.
+static void* test_calloc(size_t count, size_t size) {
+  atomic_fetch_add(&test_allocations, 1);
+  return calloc(count, size);
+}
 
-   Runtime: O(N + X * log (X))
-   Memory space: O(2 * X), the `2` comes from the fact that we store both
-   pixels values + pixel positions
-*/
+static void* test_aligned_alloc(size_t alignment, size_t size) {
+  atomic_fetch_add(&test_allocations, 1);
+  return aligned_alloc(alignment, size);
+}
 
-#define MAX_HEAP_CAPACITY 50
-#define HIGH_PIXELS_NUM MAX_HEAP_CAPACITY
+#define malloc(size) test_malloc(size)
+#define calloc(count, size) test_calloc(count, size)
+#define aligned_alloc(alignment, size) test_aligned_alloc(alignment, size)
+
+#include "highpixel.c"
+
+#define HIGH_PIXELS_NUM 50
 #define IMAGE_SIZE_X 64
 #define IMAGE_SIZE_Y 64
 
@@ -30,309 +39,1751 @@
 #error "invalid pixel count"
 #endif
 
-#define SWAP(a, b, t) (((t) = (a), (a) = (b), (b) = (t)))
+/*
+	linear time oracle: `heap` must be a valid min heap of min(N, capacity)
+	distinct pixels of the image, with their values. Its root then ranks
+	below all the other items, so they are the top X exactly when the image
+	has size - 1 pixels ranking above the root: a greater value, or the same
+	value and a lower offset. The image is left untouched.
+*/
+static int8_t check_high_pixels(const image_t* image, const heap_t* heap) {
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  uint32_t expected = size < heap->capacity ? size : heap->capacity;
+  const uint16_t* pixels = image->pixels;
 
-/* Image object type */
-typedef struct {
-  uint16_t* pixels; /* pixel array with size = size_x * size_y*/
-  /* fits most image use cases */
-  uint16_t size_x; /* image rows count */
-  uint16_t size_y; /* image columns */
-} image_t;
+  if (heap->size != expected) return 0;
 
-/* Integer heap type */
-typedef struct {
-  uint32_t capacity; /* heap max capacity */
-  uint32_t size;     /* current heap size */
-  uint32_t* offsets; /* holds pixel index */
-  uint16_t* values;  /* holds value or pixel value */
-
-  /* use separate arrays for index and value in order to
-     take advantage of data locality (cache usage) and
-     allocate less memory than putting them in a structure due to padding:
-	 E.g.
-     struct {
-		uint32_t offsets;
-        uint16_t values;
-     } items[10];
-
-    uint32_t offsets[10];
-	uint16_t values[10];
-
-	sizeof(items) > sizeof(offsets) + sizeof(values)
-*/
-} heap_t;
+  if (!expected) return 1;
 
-/*
-	Initialize image with random 16-bit data
-    returns negative value on fail, 0 otherwise
-*/
-int32_t init_image(image_t* image, uint16_t x, uint16_t y) {
-  if (!image || !x || !y) return -1;
+  uint8_t* seen = (uint8_t*)calloc(size / 8 + 1, 1);
+
+  if (!seen) exit(1);
 
-  uint32_t size = x * y;
+  int8_t valid = 1;
 
-  image->pixels = (uint16_t*)malloc(size * sizeof(*image->pixels));
+  for (uint32_t i = 0; i < heap->size && valid; ++i) {
+    uint32_t offset = heap->offsets[i];
 
-  if (!image->pixels) return -1;
+    valid = offset < size && !(seen[offset / 8] & 1 << offset % 8) &&
+            pixels[offset] == heap->values[i] &&
+            (!i || !heap_item_less(heap->values[i], offset,
+                                   heap->values[(i - 1) / 2],
+                                   heap->offsets[(i - 1) / 2]));
 
-  image->size_x = x;
-  image->size_y = y;
+    if (valid) seen[offset / 8] |= 1 << offset % 8;
+  }
 
-  srand(time(0));
+  free(seen);
 
-  for (int i = 0; i < size; ++i) image->pixels[i] = rand() & 0xff;
+  uint16_t value = heap->values[0];
+  uint32_t offset = heap->offsets[0];
+  uint32_t above = 0;
 
-  return 0;
+  for (uint32_t i = 0; i < size; ++i)
+    above += pixels[i] > value || (pixels[i] == value && i < offset);
+
+  return valid && above == expected - 1;
 }
 
-/* check image validity */
-static inline int8_t image_check_valid(const image_t* image) {
-  return image && image->pixels;
+/* pixels greater than `value` */
+static uint32_t count_above(const image_t* image, uint16_t value) {
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  uint32_t above = 0;
+
+  for (uint32_t i = 0; i < size; ++i) above += image->pixels[i] > value;
+
+  return above;
 }
 
+/* results checked against the reference heap, see run_test() */
+#define TEST_RESULTS (ENGINE_COUNT + 2)
+#define TEST_PARALLEL ENGINE_COUNT
+#define TEST_SHARED (ENGINE_COUNT + 1)
+
+/* tests a particular image size and top X pixel values */
+static void run_test(uint16_t x, uint16_t y, uint32_t high_num) {
+  uint32_t size = (uint32_t)x * y;
+  heap_t high_pixels;
+  heap_t results[TEST_RESULTS];
+  image_t image;
+
+  if (init_heap(&high_pixels, high_num)) exit(1);
+
+  /* every distribution, the 8-bit ones produce lots of ties */
+  if (init_image_ex(&image, x, y, (dist_t)((x + y + high_num) % DIST_COUNT),
+                    (uint64_t)x << 48 | (uint64_t)y << 32 | high_num)) {
+    free_heap(&high_pixels);
+    exit(1);
+  }
+
+  /* build the reference top X pixel heap */
+  build_high_pixels_with(&image, &high_pixels, SCAN_KERNEL_SCALAR);
+
+  /* every supported kernel must produce the exact same heap as the scalar */
+  for (scan_kernel_t k = SCAN_KERNEL_SCALAR; k < SCAN_KERNEL_COUNT; ++k) {
+    heap_t kernel_pixels;
+
+    if (!scan_kernel_get(k)) continue;
+
+    if (init_heap(&kernel_pixels, high_num)) exit(1);
+
+    build_high_pixels_with(&image, &kernel_pixels, k);
+
+    if (kernel_pixels.size != high_pixels.size ||
+        memcmp(kernel_pixels.values, high_pixels.values,
+               high_pixels.size * sizeof(*high_pixels.values)) ||
+        memcmp(kernel_pixels.offsets, high_pixels.offsets,
+               high_pixels.size * sizeof(*high_pixels.offsets))) {
+      heap_print(&kernel_pixels, image.size_y);
+      printf("kernel %d tests failed :(\n", k);
+      exit(1);
+    }
+
+    free_heap(&kernel_pixels);
+  }
+
+  /* a view of the whole image must not change the heap either */
+  heap_t view_pixels;
+  image_view_t view;
+
+  if (init_heap(&view_pixels, high_num) ||
+      init_image_view(&view, &image, 0, 0, x, y) ||
+      build_high_pixels_view(&view, &view_pixels) < 0 ||
+      view_pixels.size != high_pixels.size ||
+      memcmp(view_pixels.values, high_pixels.values,
+             high_pixels.size * sizeof(*high_pixels.values)) ||
+      memcmp(view_pixels.offsets, high_pixels.offsets,
+             high_pixels.size * sizeof(*high_pixels.offsets))) {
+    printf("view tests failed :(\n");
+    exit(1);
+  }
+
+  /* ROI: same result as the copied out sub-image, in source coordinates */
+  uint16_t roi_rows = (x + 1) / 2, roi_columns = (y + 2) / 3;
+  uint16_t roi_row = x / 3, roi_column = y - roi_columns;
+  image_t roi;
+
+  view_pixels.size = 0;
+
+  if (init_image_view(&view, &image, roi_row, roi_column, roi_rows,
+                      roi_columns) ||
+      build_high_pixels_view(&view, &view_pixels) < 0 ||
+      init_image(&roi, roi_rows, roi_columns))
+    exit(1);
+
+  for (uint32_t r = 0; r < roi_rows; ++r)
+    memcpy(roi.pixels + r * roi_columns, view.base + r * view.pitch,
+           roi_columns * sizeof(*roi.pixels));
+
+  heap_t roi_pixels;
+
+  if (init_heap(&roi_pixels, high_num)) exit(1);
+
+  build_high_pixels_with(&roi, &roi_pixels, SCAN_KERNEL_SCALAR);
+
+  if (roi_pixels.size != view_pixels.size) exit(1);
+
+  while (roi_pixels.size) {
+    heap_min_pop(&roi_pixels);
+    heap_min_pop(&view_pixels);
+
+    uint32_t offset = roi_pixels.offsets[roi_pixels.size];
+
+    if (view_pixels.offsets[view_pixels.size] !=
+            (roi_row + offset / roi_columns) * y + roi_column +
+                offset % roi_columns ||
+        view_pixels.values[view_pixels.size] !=
+            roi_pixels.values[roi_pixels.size]) {
+      printf("roi tests failed :(\n");
+      exit(1);
+    }
+  }
+
+  free_heap(&roi_pixels);
+  free_heap(&view_pixels);
+  free_image(&roi);
+
+  /* streaming the image in chunks must not change the heap either */
+  heap_t stream_pixels;
+  high_pixels_stream_t stream;
+
+  if (init_heap(&stream_pixels, high_num) ||
+      high_pixels_stream_begin(&stream, &stream_pixels))
+    exit(1);
+
+  for (uint32_t i = 0, chunk = 1; i < size; i += chunk, chunk += y)
+    if (high_pixels_stream_feed(&stream, image.pixels + i,
+                                size - i < chunk ? size - i : chunk) < 0)
+      exit(1);
+
+  if (high_pixels_stream_finalize(&stream) != size ||
+      stream_pixels.size != high_pixels.size ||
+      memcmp(stream_pixels.values, high_pixels.values,
+             high_pixels.size * sizeof(*high_pixels.values)) ||
+      memcmp(stream_pixels.offsets, high_pixels.offsets,
+             high_pixels.size * sizeof(*high_pixels.offsets))) {
+    heap_print(&stream_pixels, image.size_y);
+    printf("stream tests failed :(\n");
+    exit(1);
+  }
+
+  free_heap(&stream_pixels);
+
+  /* the other engines must select the exact same pixels */
+  for (uint32_t r = 0; r < TEST_RESULTS; ++r) {
+    int32_t err;
+
+    if (init_heap(&results[r], high_num)) exit(1);
+
+    /* tiny bands, so small images get workers */
+    if (r == TEST_PARALLEL || r == TEST_SHARED)
+      err = build_high_pixels_bands(&image, &results[r], 4, 1 + x % 3,
+                                    r == TEST_SHARED);
+    else
+      err = build_high_pixels_engine(&image, &results[r], (engine_t)r);
+
+    if (err < 0 || results[r].size != high_pixels.size) {
+      printf("engine %u build failed :(\n", r);
+      exit(1);
+    }
+  }
+
+  /* ranked extraction, the heap must be left untouched */
+  uint16_t* rows = (uint16_t*)malloc(3 * (high_pixels.size + 1) * sizeof(*rows));
+  uint16_t* cols = rows + high_pixels.size + 1;
+  uint16_t* values = cols + high_pixels.size + 1;
+
+  if (!rows ||
+      high_pixels_extract(&high_pixels, y, rows, cols, values) !=
+          high_pixels.size)
+    exit(1);
+
+  for (uint32_t i = 0; i < high_pixels.size; ++i)
+    if (rows[i] * y + cols[i] != high_pixels.offsets[i] ||
+        values[i] != high_pixels.values[i]) {
+      printf("extract tests failed :(\n");
+      exit(1);
+    }
+
+  if (high_pixels_extract_sorted(&high_pixels, y, rows, cols, values) !=
+      high_pixels.size)
+    exit(1);
+
+  /* the reference is the exact top X */
+  if (!check_high_pixels(&image, &high_pixels)) {
+    heap_print(&high_pixels, image.size_y);
+    printf("tests failed :(\n");
+    exit(1);
+  }
+
+  /* the sorted extraction and the engines pop in the reference order */
+  while (high_pixels.size) {
+    heap_min_pop(&high_pixels);
+
+    uint32_t rank = high_pixels.size;
+
+    if (values[rank] != high_pixels.values[rank] ||
+        rows[rank] * y + cols[rank] != high_pixels.offsets[rank]) {
+      printf("extract sorted tests failed :(\n");
+      exit(1);
+    }
+
+    for (uint32_t r = 0; r < TEST_RESULTS; ++r) {
+      heap_min_pop(&results[r]);
+      if (results[r].offsets[results[r].size] != high_pixels.offsets[rank] ||
+          results[r].values[results[r].size] != high_pixels.values[rank]) {
+        printf("engine %u tests failed :(\n", r);
+        exit(1);
+      }
+    }
+  }
+
+  free(rows);
+  free_image(&image);
+  free_heap(&high_pixels);
+
+  for (uint32_t r = 0; r < TEST_RESULTS; ++r) free_heap(&results[r]);
+}
+
+/* property tests results: the engines, then the parallel builds */
+#define PROPERTY_PARALLEL ENGINE_COUNT
+#define PROPERTY_SHARED (ENGINE_COUNT + 1)
+
 /*
-        Frees image object.
+	randomized property tests: random geometry, distribution, X, engine and
+	threads, every result checked with check_high_pixels(). The pixel count
+	and X are log-uniform so both tiny and huge ones show up. A failing round
+	reports its parameters, the same seed replays it.
 */
-void free_image(image_t* image) {
-  if (!image_check_valid(image)) return;
+static void run_property_test(uint64_t seed, uint32_t rounds,
+                              uint32_t min_pixels, uint32_t max_pixels) {
+  uint32_t bits = 32 - __builtin_clz(max_pixels);
+  rng_t rng;
+
+  rng_seed(&rng, seed);
+
+  for (uint32_t round = 0; round < rounds; ++round) {
+    uint64_t span = (uint64_t)1 << (1 + rng_next(&rng) % bits);
+    uint32_t target =
+        1 + rng_next(&rng) % (span < max_pixels ? span : max_pixels);
+
+    if (target < min_pixels) target = min_pixels;
+
+    uint32_t x =
+        1 + rng_next(&rng) % (target < UINT16_MAX ? target : UINT16_MAX);
+    uint32_t y = target / x < UINT16_MAX ? target / x : UINT16_MAX;
+    uint32_t high_num = 1 + rng_next(&rng) % (1u << (rng_next(&rng) % 21));
+    uint32_t build = rng_next(&rng) % (ENGINE_COUNT + 2);
+    uint32_t threads = 1 + rng_next(&rng) % 8;
+    dist_t dist = (dist_t)(rng_next(&rng) % DIST_COUNT);
+    image_t image;
+    heap_t heap;
+    int32_t err;
+
+    if (init_image_ex(&image, (uint16_t)x, (uint16_t)y, dist,
+                      rng_next(&rng)) ||
+        init_heap(&heap, high_num))
+      exit(1);
+
+    if (build == PROPERTY_PARALLEL)
+      err = build_high_pixels_parallel(&image, &heap, threads);
+    else if (build == PROPERTY_SHARED)
+      err = build_high_pixels_parallel_shared(&image, &heap, threads);
+    else
+      err = build_high_pixels_engine(&image, &heap, (engine_t)build);
+
+    if (err < 0 || !check_high_pixels(&image, &heap)) {
+      printf(
+          "property round %u of seed %llu failed: %ux%u dist %d X=%u build "
+          "%u threads %u :(\n",
+          round, (unsigned long long)seed, x, y, dist, high_num, build,
+          threads);
+      exit(1);
+    }
+
+    free_heap(&heap);
+    free_image(&image);
+  }
+}
+
+/* writes a 16-bit value with the given byte order */
+static void put16(FILE* f, uint16_t v, int8_t big) {
+  fputc(big ? v >> 8 : v & 0xff, f);
+  fputc(big ? v & 0xff : v >> 8, f);
+}
 
-  free(image->pixels);
+static void put32(FILE* f, uint32_t v, int8_t big) {
+  put16(f, big ? v >> 16 : v & 0xffff, big);
+  put16(f, big ? v & 0xffff : v >> 16, big);
 }
 
-/* check heap validity */
-static inline int8_t heap_check_valid(const heap_t* heap) {
-  return heap && heap->offsets && heap->values;
+/* writes a TIFF IFD entry with a single value or an offset */
+static void put_tiff_entry(FILE* f, uint16_t tag, uint16_t type,
+                           uint32_t count, uint32_t value, int8_t big) {
+  put16(f, tag, big);
+  put16(f, type, big);
+  put32(f, count, big);
+
+  if (type == TIFF_SHORT && count == 1) {
+    put16(f, (uint16_t)value, big);
+    put16(f, 0, big);
+  } else {
+    put32(f, value, big);
+  }
 }
 
 /*
-		Initialize heap object with provided capacity.
+	writes a TIFF file with one strip per row; `reversed` stores the strips
+	in reverse order so they are not contiguous.
+*/
+static void write_tiff(FILE* f, const image_t* image, int8_t big,
+                       int8_t reversed) {
+  uint32_t rows = image->size_x;
+  uint32_t columns = image->size_y;
+  uint32_t entries = 7;
+  uint32_t tables = 8 + 2 + entries * 12 + 4; /* strip tables offset */
+  uint32_t data = tables + 2 * rows * 4;      /* pixels offset */
+  uint32_t row_bytes = columns * 2;
+
+  fputs(big ? "MM" : "II", f);
+  put16(f, 42, big);
+  put32(f, 8, big);
+  put16(f, entries, big);
+  put_tiff_entry(f, TIFF_IMAGE_WIDTH, TIFF_LONG, 1, columns, big);
+  put_tiff_entry(f, TIFF_IMAGE_LENGTH, TIFF_LONG, 1, rows, big);
+  put_tiff_entry(f, TIFF_BITS_PER_SAMPLE, TIFF_SHORT, 1, 16, big);
+  put_tiff_entry(f, TIFF_COMPRESSION, TIFF_SHORT, 1, 1, big);
+  put_tiff_entry(f, TIFF_STRIP_OFFSETS, TIFF_LONG, rows,
+                 rows > 1 ? tables : data, big);
+  put_tiff_entry(f, TIFF_SAMPLES_PER_PIXEL, TIFF_SHORT, 1, 1, big);
+  put_tiff_entry(f, TIFF_STRIP_BYTE_COUNTS, TIFF_LONG, rows,
+                 rows > 1 ? tables + rows * 4 : row_bytes, big);
+  put32(f, 0, big);
+
+  for (uint32_t r = 0; r < rows; ++r)
+    put32(f, data + (reversed ? rows - 1 - r : r) * row_bytes, big);
+
+  for (uint32_t r = 0; r < rows; ++r) put32(f, row_bytes, big);
+
+  for (uint32_t r = 0; r < rows; ++r) {
+    uint32_t row = reversed ? rows - 1 - r : r;
+
+    for (uint32_t c = 0; c < columns; ++c)
+      put16(f, image->pixels[row * columns + c], big);
+  }
+}
 
-        return 0 on success, != 0 otherwise
+/* loads the file and compares it against the source image */
+static void check_load(const image_t* image, const char* path, int32_t raw,
+                       int8_t borrowed) {
+  image_t loaded;
+  uint32_t size = (uint32_t)image->size_x * image->size_y;
+  int32_t err = raw ? load_image_raw(&loaded, path, image->size_x,
+                                     image->size_y)
+                    : load_image(&loaded, path);
+
+  if (err || loaded.size_x != image->size_x ||
+      loaded.size_y != image->size_y || loaded.borrowed != borrowed ||
+      memcmp(loaded.pixels, image->pixels, size * sizeof(*image->pixels)) ||
+      /* the borrowed mapped pixels are read only */
+      (fill_image(&loaded, DIST_UNIFORM, 1, 1) < 0) != borrowed) {
+    printf("load %s tests failed :(\n", path);
+    exit(1);
+  }
+
+  free_image(&loaded);
+}
+
+/* tests the file loaders against an image of a particular size */
+static void run_load_test(uint16_t x, uint16_t y) {
+  char path[] = "/tmp/highpixel-XXXXXX";
+  uint32_t size = (uint32_t)x * y;
+  image_t image;
+  int fd = mkstemp(path);
+  FILE* f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+
+  if (!f || init_image(&image, x, y)) exit(1);
+
+  fwrite(image.pixels, sizeof(*image.pixels), size, f);
+  fflush(f);
+  check_load(&image, path, 1, 1);
+
+  /*
+      with an odd header length the pixels can't be used in place, nor with
+      the big endian PGM samples on little endian hosts
+  */
+  for (int8_t comment = 0; comment < 2; ++comment) {
+    rewind(f);
+    int header =
+        fprintf(f, "P5\n%s%hu %hu\n65535\n", comment ? "#\n" : "", y, x);
+    for (uint32_t i = 0; i < size; ++i) put16(f, image.pixels[i], 1);
+    fflush(f);
+    check_load(&image, path, 0, !(header & 1) && HOST_BIG_ENDIAN);
+  }
+
+  for (int8_t big = 0; big < 2; ++big)
+    for (int8_t reversed = 0; reversed < 2; ++reversed) {
+      rewind(f);
+      write_tiff(f, &image, big, reversed);
+      fflush(f);
+      check_load(&image, path, 0,
+                 (!reversed || x == 1) && big == HOST_BIG_ENDIAN);
+    }
+
+  fclose(f);
+  unlink(path);
+  free_image(&image);
+}
+
+/* every tile heap must match the build of the same tile view */
+static void run_tile_test(uint16_t x, uint16_t y, uint16_t tile_rows,
+                          uint16_t tile_columns, uint32_t k) {
+  image_t image;
+  tile_pixels_t tiles;
+
+  if (init_image_ex(&image, x, y, (dist_t)((x + k) % DIST_COUNT), x * y) ||
+      init_tile_pixels(&tiles, x, y, tile_rows, tile_columns, k) ||
+      build_tile_high_pixels(&image, &tiles, 3) < 0)
+    exit(1);
+
+  for (uint32_t ty = 0; ty < tiles.tiles_y; ++ty)
+    for (uint32_t tx = 0; tx < tiles.tiles_x; ++tx) {
+      heap_t* heap = &tiles.arena.heaps[ty * tiles.tiles_x + tx];
+      uint32_t row = ty * tile_rows, column = tx * tile_columns;
+      heap_t high_pixels;
+      image_view_t view;
+
+      if (init_heap(&high_pixels, k) ||
+          init_image_view(&view, &image, row, column,
+                          x - row < tile_rows ? x - row : tile_rows,
+                          y - column < tile_columns ? y - column
+                                                    : tile_columns) ||
+          build_high_pixels_view(&view, &high_pixels) < 0)
+        exit(1);
+
+      if (heap->size != high_pixels.size ||
+          memcmp(heap->values, high_pixels.values,
+                 high_pixels.size * sizeof(*high_pixels.values)) ||
+          memcmp(heap->offsets, high_pixels.offsets,
+                 high_pixels.size * sizeof(*high_pixels.offsets))) {
+        heap_print(heap, y);
+        printf("tile tests failed :(\n");
+        exit(1);
+      }
+
+      free_heap(&high_pixels);
+    }
+
+  free_tile_pixels(&tiles);
+  free_image(&image);
+}
+
+/* wide builds must match a 32-bit stream over the same pixels */
+static void run_wide_test(uint64_t rows, uint64_t columns, uint64_t chunk,
+                          uint32_t high_num) {
+  image_wide_t image;
+  heap_wide_t wide;
+  heap_t reference;
+  high_pixels_stream_t stream;
+
+  if (init_image_wide(&image, rows, columns,
+                      (dist_t)((rows + high_num) % DIST_COUNT), rows * columns) ||
+      init_heap_wide(&wide, high_num) || init_heap(&reference, high_num) ||
+      high_pixels_stream_begin(&stream, &reference) < 0 ||
+      high_pixels_stream_feed(&stream, image.pixels, rows * columns) < 0 ||
+      high_pixels_stream_finalize(&stream) < 0)
+    exit(1);
+
+  if ((chunk ? build_high_pixels_wide_chunks(&image, &wide, 3, chunk)
+             : build_high_pixels_wide(&image, &wide, 3)) < 0 ||
+      wide.size != reference.size)
+    exit(1);
+
+  while (reference.size) {
+    uint64_t offset;
+    uint16_t value;
+
+    if (heap_wide_pop(&wide, &offset, &value) ||
+        offset != reference.offsets[0] || value != reference.values[0]) {
+      printf("wide tests failed :(\n");
+      exit(1);
+    }
+
+    heap_min_pop(&reference);
+  }
+
+  free_heap(&reference);
+  free_heap_wide(&wide);
+  free_image_wide(&image);
+}
+
+/*
+	a wide frame past 2^31 pixels, fitting image_t, goes through the 32-bit
+	parallel build: a zero mapping, only the pages of the spikes are backed,
+	with ties on both sides of 2^31. Skipped if the mapping is refused.
 */
-int32_t init_heap(heap_t* heap, uint32_t capacity) {
-  if (capacity > MAX_HEAP_CAPACITY || !heap) return -1;
+static void run_wide_spikes_test(uint64_t rows, uint64_t columns,
+                                 uint32_t spikes) {
+  uint64_t size = rows * columns;
+  size_t bytes = (size_t)size * sizeof(uint16_t);
+  heap_wide_t wide, reference;
 
-  heap->offsets = (uint32_t*)malloc(capacity * sizeof(*heap->offsets));
+  if (size > SIZE_MAX / sizeof(uint16_t)) return;
 
-  if (!heap->offsets) return -1;
+  uint16_t* pixels = (uint16_t*)mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                     -1, 0);
 
-  heap->values = (uint16_t*)malloc(capacity * sizeof(*heap->values));
+  if (pixels == MAP_FAILED) return;
 
-  if (!heap->values) {
-    free(heap->offsets);
-    return -1;
+  image_wide_t image = {pixels, rows, columns, 1};
+
+  if (init_heap_wide(&wide, spikes) || init_heap_wide(&reference, spikes))
+    exit(1);
+
+  for (uint32_t k = 0; k < spikes; ++k) {
+    uint64_t offset = k * (size / spikes) + k * 7;
+    uint16_t value = (uint16_t)(100 + k % 5);
+
+    pixels[offset] = value;
+    if (heap_wide_offer(&reference, offset, value)) exit(1);
   }
 
-  heap->capacity = capacity;
-  heap->size = 0;
+  if (build_high_pixels_wide(&image, &wide, 3) < 0 ||
+      wide.size != reference.size)
+    exit(1);
 
-  return 0;
+  while (reference.size) {
+    uint64_t offset, expected;
+    uint16_t value, expected_value;
+
+    if (heap_wide_pop(&wide, &offset, &value) ||
+        heap_wide_pop(&reference, &expected, &expected_value) ||
+        offset != expected || value != expected_value) {
+      printf("wide spikes tests failed :(\n");
+      exit(1);
+    }
+  }
+
+  free_heap_wide(&reference);
+  free_heap_wide(&wide);
+  munmap(pixels, bytes);
 }
 
 /*
-        Deallocates heap resources
+	typed builds must match the 16-bit scalar kernel on a frame with the
+	same order: u8 takes the high byte, u32 and f32 monotonic maps of the
+	16-bit values; RAW12 packs the low 12 bits.
 */
-void free_heap(heap_t* heap) {
-  if (!heap_check_valid(heap)) return;
+static void run_typed_test(uint16_t x, uint16_t y, uint32_t high_num) {
+  uint32_t size = (uint32_t)x * y;
+  size_t stride = (y + 1) / 2 * 3 + 5;
+  image_t image, reference;
+  heap_t heap, raw;
+  heap_u8_t heap_u8;
+  heap_u32_t heap_u32;
+  heap_f32_t heap_f32, heap_nan;
+  image_u8_t image_u8 = {malloc(size), x, y};
+  image_u32_t image_u32 = {malloc(size * sizeof(uint32_t)), x, y};
+  image_f32_t image_f32 = {malloc(size * sizeof(float)), x, y};
+  uint8_t* packed = calloc(x, stride);
+
+  if (init_image_ex(&image, x, y, (dist_t)((x * y + high_num) % DIST_COUNT),
+                    size) ||
+      init_image_ex(&reference, x, y, DIST_UNIFORM, 0) ||
+      init_heap(&heap, high_num) || init_heap(&raw, high_num) ||
+      init_heap_u8(&heap_u8, high_num) || init_heap_u32(&heap_u32, high_num) ||
+      init_heap_f32(&heap_f32, high_num) ||
+      init_heap_f32(&heap_nan, high_num) || !image_u8.pixels ||
+      !image_u32.pixels || !image_f32.pixels || !packed)
+    exit(1);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    image_u8.pixels[i] = image.pixels[i] >> 8;
+    image_u32.pixels[i] = image.pixels[i] * 65536u + 3;
+    image_f32.pixels[i] = (image.pixels[i] - 32768) * 0.25f;
+  }
+
+  /* 16-bit frame, through the generic entry point too */
+  if (build_high_pixels_typed(&image, &heap) < 0 ||
+      build_high_pixels_typed(&image_u32, &heap_u32) < 0 ||
+      build_high_pixels_typed(&image_f32, &heap_f32) < 0 ||
+      heap_u32.size != heap.size || heap_f32.size != heap.size)
+    exit(1);
+
+  while (heap.size) {
+    uint16_t v = heap.values[0];
+    uint32_t offset = heap.offsets[0];
+
+    if (heap_u32.values[0] != v * 65536u + 3 ||
+        heap_f32.values[0] != (v - 32768) * 0.25f ||
+        heap_u32_pop(&heap_u32) != (int32_t)offset ||
+        heap_f32_pop(&heap_f32) != (int32_t)offset) {
+      printf("typed tests failed :(\n");
+      exit(1);
+    }
+
+    heap_min_pop(&heap);
+  }
+
+  /* 8-bit frame */
+  for (uint32_t i = 0; i < size; ++i)
+    reference.pixels[i] = image_u8.pixels[i];
+
+  heap.size = 0;
+
+  if (build_high_pixels_with(&reference, &heap, SCAN_KERNEL_SCALAR) < 0 ||
+      build_high_pixels_typed(&image_u8, &heap_u8) < 0 ||
+      heap_u8.size != heap.size ||
+      memcmp(heap_u8.offsets, heap.offsets, heap.size * sizeof(*heap.offsets)))
+    exit(1);
+
+  for (uint32_t i = 0; i < heap.size; ++i)
+    if (heap_u8.values[i] != heap.values[i]) exit(1);
+
+  /* NaN pixels are skipped, -inf pixels are the next lowest */
+  for (uint32_t i = 0; i < size; i += 7) image_f32.pixels[i] = NAN;
+
+  if (build_high_pixels_f32(&image_f32, &heap_nan) < 0) exit(1);
+
+  for (uint32_t i = 0; i < size; i += 7) image_f32.pixels[i] = -INFINITY;
 
-  free(heap->offsets);
-  free(heap->values);
+  if (build_high_pixels_f32(&image_f32, &heap_f32) < 0) exit(1);
+
+  for (uint32_t i = 0; i < heap_nan.size; ++i)
+    if (isnan(heap_nan.values[i])) exit(1);
+
+  if (size - (size + 6) / 7 >= high_num) {
+    if (heap_nan.size != heap_f32.size) exit(1);
+
+    while (heap_nan.size)
+      if (heap_f32_pop(&heap_nan) != heap_f32_pop(&heap_f32)) exit(1);
+  } else if (heap_nan.size != size - (size + 6) / 7) {
+    exit(1);
+  }
+
+  /* 12-bit packed frame */
+  for (uint32_t i = 0; i < size; ++i) {
+    uint16_t v = image.pixels[i] & 0xfff;
+    uint8_t* p = packed + i / y * stride + i % y / 2 * 3;
+
+    reference.pixels[i] = v;
+    p[i % y & 1] = v >> 4;
+    p[2] |= (v & 0xf) << ((i % y & 1) << 2);
+  }
+
+  heap.size = 0;
+
+  if (build_high_pixels_with(&reference, &heap, SCAN_KERNEL_SCALAR) < 0 ||
+      build_high_pixels_raw12(packed, stride, x, y, &raw) < 0 ||
+      raw.size != heap.size ||
+      memcmp(raw.offsets, heap.offsets, heap.size * sizeof(*heap.offsets)) ||
+      memcmp(raw.values, heap.values, heap.size * sizeof(*heap.values))) {
+    printf("raw12 tests failed :(\n");
+    exit(1);
+  }
+
+  free(packed);
+  free(image_f32.pixels);
+  free(image_u32.pixels);
+  free(image_u8.pixels);
+  free_heap_f32(&heap_nan);
+  free_heap_f32(&heap_f32);
+  free_heap_u32(&heap_u32);
+  free_heap_u8(&heap_u8);
+  free_heap(&raw);
+  free_heap(&heap);
+  free_image(&reference);
+  free_image(&image);
 }
 
-/* check if heap if full, i.e. reach its capacity */
-static inline int8_t heap_full(const heap_t* heap) {
-  return !heap_check_valid(heap) || heap->size >= heap->capacity;
+/* the stack top X must match a single heap over the concatenated images */
+static void run_stack_test(uint32_t count, uint16_t x, uint16_t y,
+                           uint32_t high_num) {
+  image_t* images = (image_t*)malloc(count * sizeof(*images));
+  stack_pixel_t* out = (stack_pixel_t*)malloc(high_num * sizeof(*out));
+  heap_wide_t reference;
+
+  if (!images || !out || init_heap_wide(&reference, high_num)) exit(1);
+
+  /* image i: sizes and distributions vary, the offsets are id << 32 | offset */
+  for (uint32_t i = 0; i < count; ++i) {
+    uint16_t rows = 1 + (x + i * 7) % x, columns = 1 + (y + i * 13) % y;
+
+    if (init_image_ex(&images[i], rows, columns, (dist_t)(i % DIST_COUNT),
+                      i * 31 + high_num))
+      exit(1);
+
+    for (uint32_t j = 0; j < rows * columns; ++j)
+      heap_wide_offer(&reference, (uint64_t)i << 32 | j, images[i].pixels[j]);
+  }
+
+  int64_t reported = build_high_pixels_stack(images, count, out, high_num, 3);
+
+  if (reported != reference.size) exit(1);
+
+  /* the reference pops in ascending order, the stack reports descending */
+  for (int64_t i = reported; i-- > 0;) {
+    uint64_t offset;
+    uint16_t value;
+
+    heap_wide_pop(&reference, &offset, &value);
+
+    if (out[i].image != offset >> 32 || out[i].value != value ||
+        out[i].row * images[out[i].image].size_y + out[i].column !=
+            (uint32_t)offset) {
+      printf("stack tests failed :(\n");
+      exit(1);
+    }
+  }
+
+  for (uint32_t i = 0; i < count; ++i) free_image(&images[i]);
+
+  free_heap_wide(&reference);
+  free(out);
+  free(images);
 }
 
-/* check if heap is empty */
-static inline int8_t heap_empty(const heap_t* heap) {
-  return !heap_check_valid(heap) || !heap->size;
+/*
+	shared threshold builds must match the scalar kernel, X = 0 included:
+	the worker heaps are then full and empty at once.
+*/
+static void run_shared_test(uint16_t x, uint16_t y, uint32_t high_num,
+                            uint32_t threads) {
+  image_t image;
+  heap_t high_pixels, reference;
+
+  if (init_image_ex(&image, x, y, (dist_t)((x + high_num) % DIST_COUNT), y) ||
+      init_heap(&high_pixels, high_num) || init_heap(&reference, high_num) ||
+      build_high_pixels_parallel_shared(&image, &high_pixels, threads) < 0 ||
+      build_high_pixels_with(&image, &reference, SCAN_KERNEL_SCALAR) < 0 ||
+      high_pixels.size != reference.size)
+    exit(1);
+
+  while (reference.size) {
+    if (heap_min_pop(&high_pixels) != heap_min_pop(&reference) ||
+        high_pixels.values[high_pixels.size] !=
+            reference.values[reference.size]) {
+      printf("shared tests failed :(\n");
+      exit(1);
+    }
+  }
+
+  free_heap(&reference);
+  free_heap(&high_pixels);
+  free_image(&image);
+}
+
+/* each frame of a sequence must match a regular build */
+static void run_temporal_test(uint16_t x, uint16_t y, uint32_t high_num) {
+  high_pixels_temporal_t temporal;
+  image_t image;
+  heap_t high_pixels, reference;
+
+  init_high_pixels_temporal(&temporal);
+
+  if (init_image_ex(&image, x, y, DIST_UNIFORM, x) ||
+      init_heap(&high_pixels, high_num) || init_heap(&reference, high_num))
+    exit(1);
+
+  for (uint32_t frame = 0; frame < 12; ++frame) {
+    /* same distribution, then darker and brighter scenes */
+    if (fill_image(&image, frame < 8 ? DIST_UNIFORM : (dist_t)(frame % 6),
+                   frame, 0))
+      exit(1);
+
+    if (frame == 5)
+      for (uint32_t i = 0; i < x * y; ++i) image.pixels[i] >>= 4;
+
+    high_pixels.size = reference.size = 0;
+
+    if (build_high_pixels_temporal(&image, &high_pixels, &temporal) < 0 ||
+        build_high_pixels_with(&image, &reference, SCAN_KERNEL_SCALAR) < 0 ||
+        high_pixels.size != reference.size)
+      exit(1);
+
+    while (reference.size) {
+      if (heap_min_pop(&high_pixels) != heap_min_pop(&reference) ||
+          high_pixels.values[high_pixels.size] !=
+              reference.values[reference.size]) {
+        printf("temporal tests failed :(\n");
+        exit(1);
+      }
+    }
+  }
+
+  /* the darker frame can't reuse the threshold */
+  if (temporal.frames != 12 ||
+      (high_num && x * y >= high_num && !temporal.misses))
+    exit(1);
+
+  free_heap(&reference);
+  free_heap(&high_pixels);
+  free_image(&image);
 }
 
-/* check if heap is empty */
-static inline uint16_t heap_peek(const heap_t* heap) {
-  return !heap_empty(heap) ? heap->values[0] : ~0;
+#ifdef HIGH_PIXEL_GPU
+/* the device build must select the same pixels as the CPU */
+static void run_gpu_test(uint16_t x, uint16_t y, uint32_t high_num) {
+  image_t image;
+  heap_t high_pixels, reference;
+  uint16_t* device;
+
+  if (init_image_ex(&image, x, y, (dist_t)((x + y) % DIST_COUNT), x * y) ||
+      init_heap(&high_pixels, high_num) || init_heap(&reference, high_num) ||
+      gpu_upload_pixels(image.pixels, x * y, &device) ||
+      build_high_pixels_gpu(device, x, y, &high_pixels) < 0 ||
+      build_high_pixels_with(&image, &reference, SCAN_KERNEL_SCALAR) < 0 ||
+      high_pixels.size != reference.size)
+    exit(1);
+
+  while (reference.size)
+    if (heap_min_pop(&high_pixels) != heap_min_pop(&reference) ||
+        high_pixels.values[high_pixels.size] !=
+            reference.values[reference.size]) {
+      printf("gpu tests failed :(\n");
+      exit(1);
+    }
+
+  gpu_free_pixels(device);
+  free_heap(&reference);
+  free_heap(&high_pixels);
+  free_image(&image);
 }
+#endif
 
 /*
-        Return the min child index (within the heap) for a parent
-        or negative if doesn't exits.
+	the fused pass must give the single scans heaps: the top heap matches the
+	scalar scan, the bottom heap the scalar scan of the inverted image.
 */
-int32_t heap_min_child_for_parent(const heap_t* heap, uint32_t parent) {
-  if (!heap_check_valid(heap)) return -1;
+static void run_extreme_test(uint16_t x, uint16_t y, uint32_t high_num,
+                             uint32_t low_num) {
+  uint32_t size = (uint32_t)x * y;
+  image_t image, inverted;
+  heap_t high, low, reference, inverted_low;
+
+  if (init_image_ex(&image, x, y, (dist_t)((x + y) % DIST_COUNT), size) ||
+      init_image_ex(&inverted, x, y, DIST_UNIFORM, 0) ||
+      init_heap(&high, high_num) || init_heap(&low, low_num) ||
+      init_heap(&reference, high_num) || init_heap(&inverted_low, low_num))
+    exit(1);
+
+  for (uint32_t i = 0; i < size; ++i)
+    inverted.pixels[i] = UINT16_MAX - image.pixels[i];
 
-  uint32_t left = (parent << 1) + 1;
+  if (build_high_pixels_with(&image, &reference, SCAN_KERNEL_SCALAR) < 0 ||
+      build_high_pixels_with(&inverted, &inverted_low, SCAN_KERNEL_SCALAR) < 0)
+    exit(1);
 
-  if (left >= heap->size) return -1;
+  for (uint32_t k = SCAN_KERNEL_AUTO; k < SCAN_KERNEL_COUNT; ++k) {
+    if (!extreme_kernel_get((scan_kernel_t)k)) continue;
 
-  uint32_t right = (parent + 1) << 1;
+    high.size = low.size = 0;
 
-  if (right >= heap->size) return left;
+    if (build_extreme_pixels_with(&image, &high, &low, (scan_kernel_t)k) < 0 ||
+        high.size != reference.size || low.size != inverted_low.size ||
+        memcmp(high.offsets, reference.offsets,
+               high.size * sizeof(*high.offsets)) ||
+        memcmp(high.values, reference.values,
+               high.size * sizeof(*high.values))) {
+      printf("extreme kernel %u tests failed :(\n", k);
+      exit(1);
+    }
+  }
 
-  return heap->values[left] < heap->values[right] ? left : right;
+  /* same bottom pixels alone, then the pop orders of the bottom heaps */
+  heap_t alone;
+
+  if (init_heap(&alone, low_num) || build_low_pixels(&image, &alone) < 0 ||
+      alone.size != low.size ||
+      memcmp(alone.offsets, low.offsets, low.size * sizeof(*low.offsets)))
+    exit(1);
+
+  while (inverted_low.size)
+    if (heap_max_pop(&low) != heap_min_pop(&inverted_low) ||
+        low.values[low.size] !=
+            UINT16_MAX - inverted_low.values[inverted_low.size]) {
+      printf("extreme tests failed :(\n");
+      exit(1);
+    }
+
+  free_heap(&alone);
+  free_heap(&inverted_low);
+  free_heap(&reference);
+  free_heap(&low);
+  free_heap(&high);
+  free_image(&inverted);
+  free_image(&image);
 }
 
-/*
-        Push new item in heap min.
+/* the approximate result must honour its rank error bound */
+static void run_approx_test(uint16_t x, uint16_t y, uint32_t high_num,
+                            uint32_t stride) {
+  uint32_t size = (uint32_t)x * y;
+  image_t image;
+  heap_t high_pixels;
+
+  if (init_image_ex(&image, x, y, (dist_t)((x + y + stride) % DIST_COUNT),
+                    size + high_num) ||
+      init_heap(&high_pixels, high_num))
+    exit(1);
+
+  int64_t bound = build_high_pixels_approx(&image, &high_pixels, stride);
+  uint32_t expected = size < high_num ? size : high_num;
+
+  if (bound < 0 || high_pixels.size != expected ||
+      bound > size - expected)
+    exit(1);
 
-        return 0 on success, != 0 otherwise
+  /* unique offsets with the pixels value */
+  uint8_t* seen = (uint8_t*)calloc(size, 1);
+
+  for (uint32_t i = 0; seen && i < high_pixels.size; ++i) {
+    uint32_t offset = high_pixels.offsets[i];
+
+    if (offset >= size || seen[offset] ||
+        image.pixels[offset] != high_pixels.values[i])
+      exit(1);
+
+    seen[offset] = 1;
+  }
+
+  free(seen);
+
+  /*
+      every reported pixel is among the first X + bound: less than X + bound
+      pixels are greater than the lowest reported value
+  */
+  uint16_t lowest = UINT16_MAX;
+
+  for (uint32_t i = 0; i < high_pixels.size; ++i)
+    if (high_pixels.values[i] < lowest) lowest = high_pixels.values[i];
+
+  if (high_pixels.size && count_above(&image, lowest) >= expected + bound) {
+    printf("approx tests failed :(\n");
+    exit(1);
+  }
+
+  free_heap(&high_pixels);
+  free_image(&image);
+}
+
+/* counters consistency, only when the stats are compiled in */
+static void run_stats_test(void) {
+  high_pixels_stats_t stats;
+  image_t image;
+  heap_t high_pixels;
+
+  high_pixels_stats_reset();
+  high_pixels_stats_get(&stats);
+
+  if (stats.scanned || stats.pushes) exit(1);
+
+  if (init_image_ex(&image, 300, 200, DIST_UNIFORM, 18) ||
+      init_heap(&high_pixels, HIGH_PIXELS_NUM) ||
+      build_high_pixels_parallel(&image, &high_pixels, 4) < 0)
+    exit(1);
+
+  while (high_pixels.size) heap_min_pop(&high_pixels);
+
+  high_pixels_stats_get(&stats);
+
+#ifdef HIGH_PIXEL_STATS
+  uint64_t sifts = 0;
+
+  for (uint32_t i = 0; i < STATS_SIFT_DEPTHS; ++i) sifts += stats.sift_depth[i];
+
+  /*
+      the band fills the worker heap then the merge pushes into the result;
+      every pop but the last and every replace sifts down once.
+  */
+  if (stats.scanned != 300 * 200 || stats.pops != HIGH_PIXELS_NUM ||
+      stats.pushes < 2 * HIGH_PIXELS_NUM || stats.candidates < stats.replaces ||
+      sifts != stats.pops - 1 + stats.replaces ||
+      !stats.ns[STATS_PHASE_SCAN]) {
+    printf("stats tests failed :(\n");
+    exit(1);
+  }
+
+  /*
+      every scan and extreme kernel counts every pixel once, the fill
+      included, also when the SIMD kernels return early: once the heap
+      minimum reaches 0xffff (the second round), and once the extreme
+      bounds are saturated on a half 0x0000, half 0xffff frame (the third)
+  */
+  heap_t low_pixels;
+
+  if (init_heap(&low_pixels, HIGH_PIXELS_NUM)) exit(1);
+
+  for (uint32_t round = 0; round < 3; ++round) {
+    if (round) memset(image.pixels, 0xff, 300 * 200 * sizeof(*image.pixels));
+    if (round == 2) memset(image.pixels, 0, 150 * 200 * sizeof(*image.pixels));
+
+    for (uint32_t k = SCAN_KERNEL_SCALAR; k < SCAN_KERNEL_COUNT; ++k) {
+      for (uint32_t extreme = 0; extreme < 2; ++extreme) {
+        if (extreme ? !extreme_kernel_get((scan_kernel_t)k)
+                    : !scan_kernel_get((scan_kernel_t)k))
+          continue;
+
+        high_pixels.size = low_pixels.size = 0;
+        high_pixels_stats_reset();
+
+        if ((extreme ? build_extreme_pixels_with(&image, &high_pixels,
+                                                 &low_pixels, (scan_kernel_t)k)
+                     : build_high_pixels_with(&image, &high_pixels,
+                                              (scan_kernel_t)k)) < 0)
+          exit(1);
+
+        high_pixels_stats_get(&stats);
+
+        if (stats.scanned != 300 * 200) {
+          printf("stats tests failed for %s kernel %u :(\n",
+                 extreme ? "extreme" : "scan", k);
+          exit(1);
+        }
+      }
+    }
+  }
+
+  free_heap(&low_pixels);
+#else
+  if (stats.scanned || stats.pushes || stats.pops) exit(1);
+#endif
+
+  free_heap(&high_pixels);
+  free_image(&image);
+}
+
+/*
+	the packed heap must pop the same items as heap_t, with and without the
+	prefetch (capacities on both sides of HEAP_PREFETCH_ITEMS).
 */
-int32_t heap_min_push(heap_t* heap, uint32_t offset, uint16_t value) {
-  if (heap_full(heap)) return -1;
+static void run_heap_key_test(uint32_t capacity, uint32_t count) {
+  heap_t heap;
+  heap_key_t heap_key;
+  rng_t rng;
+
+  if (init_heap(&heap, capacity) || init_heap_key(&heap_key, capacity)) exit(1);
+
+  if ((uintptr_t)heap.offsets % HEAP_ALIGN ||
+      (uintptr_t)heap.values % HEAP_ALIGN ||
+      (uintptr_t)heap_key.keys % HEAP_ALIGN)
+    exit(1);
 
-  uint32_t* offsets = heap->offsets;
-  uint16_t* values = heap->values;
-  uint32_t parent = heap->size;
+  rng_seed(&rng, count);
 
-  while (parent > 0) { /* stop if we reached the root */
-    uint32_t child = parent;
-    parent = (parent - 1) >> 1; /* get parent index: (child - 1) / 2 */
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t r = rng_next(&rng);
+    /* few values for lots of ties, 32-bit offsets in any order */
+    uint16_t value = (uint16_t)(r % 97);
+    uint32_t offset = (uint32_t)(r >> 32);
+    uint64_t key = pixel_key(value, offset);
 
-    /* reach insertion point */
-    if (values[parent] < value) {
-      parent = child;
-      break;
+    /* every other item replaces the top directly, offsets from 2^31 too */
+    if (i & 1 && capacity && heap.size == capacity) {
+      uint32_t replaced = 0;
+
+      if (key > heap_key.keys[0] &&
+          (heap_min_replace_top(&heap, offset, value, &replaced) ||
+           replaced != pixel_key_offset(heap_key.keys[0])))
+        exit(1);
+    } else if (heap_min_offer(&heap, offset, value)) {
+      exit(1);
     }
 
-    /* move parent to child location */
-    values[child] = values[parent];
-    offsets[child] = offsets[parent];
+    if (heap_key.size < capacity)
+      heap_key_push(&heap_key, key);
+    else if (capacity && key > heap_key.keys[0])
+      heap_key_replace_top(&heap_key, key);
   }
 
-  values[parent] = value;
-  offsets[parent] = offset;
-  heap->size += 1;
+  if (heap.size != heap_key.size) exit(1);
 
-  return 0;
+  while (heap.size) {
+    uint64_t key = heap_key_pop(&heap_key);
+
+    if (pixel_key_offset(key) != heap.offsets[0] ||
+        pixel_key_value(key) != heap.values[0]) {
+      printf("packed heap tests failed :(\n");
+      exit(1);
+    }
+
+    heap_min_pop(&heap);
+  }
+
+  free_heap_key(&heap_key);
+  free_heap(&heap);
 }
 
 /*
-        Pop min element from heap
+	an engine seeded with the items of another frame, offsets in any order,
+	must keep the same pixels as the select engine, which compares keys.
+*/
+static void run_seed_test(uint16_t x, uint16_t y, uint32_t high_num,
+                          engine_t engine) {
+  image_t seed, image;
+  heap_t seeded, select;
+
+  if (init_image_ex(&seed, y, x, DIST_UNIFORM8, x) ||
+      init_image_ex(&image, x, y, DIST_UNIFORM8, y) ||
+      init_heap(&seeded, high_num) || init_heap(&select, high_num))
+    exit(1);
+
+  build_high_pixels_engine(&seed, &seeded, ENGINE_HISTOGRAM);
+  build_high_pixels_engine(&seed, &select, ENGINE_HISTOGRAM);
 
-        return negative value on failure, >= 0 otherwise representing the offset
+  if (build_high_pixels_engine(&image, &seeded, engine) < 0 ||
+      build_high_pixels_engine(&image, &select, ENGINE_SELECT) < 0 ||
+      seeded.size != select.size)
+    exit(1);
+
+  for (; select.size; heap_min_pop(&seeded), heap_min_pop(&select))
+    if (seeded.offsets[0] != select.offsets[0] ||
+        seeded.values[0] != select.values[0]) {
+      printf("engine %d seed tests failed :(\n", engine);
+      exit(1);
+    }
+
+  free_heap(&select);
+  free_heap(&seeded);
+  free_image(&image);
+  free_image(&seed);
+}
+
+/* same items in the same rank order, the heaps are left untouched */
+static int8_t heaps_match(const heap_t* a, const heap_t* b) {
+  heap_t x, y;
+  int8_t match = a->size == b->size;
+
+  if (init_heap(&x, a->size) || init_heap(&y, b->size)) exit(1);
+
+  x.size = a->size;
+  y.size = b->size;
+  memcpy(x.offsets, a->offsets, a->size * sizeof(*a->offsets));
+  memcpy(x.values, a->values, a->size * sizeof(*a->values));
+  memcpy(y.offsets, b->offsets, b->size * sizeof(*b->offsets));
+  memcpy(y.values, b->values, b->size * sizeof(*b->values));
+
+  for (; match && x.size; heap_min_pop(&x), heap_min_pop(&y))
+    match = x.offsets[0] == y.offsets[0] && x.values[0] == y.values[0];
+
+  free_heap(&y);
+  free_heap(&x);
+
+  return match;
+}
+
+/* filter parts enabled by run_filter_test() */
+#define FILTER_MASK 1
+#define FILTER_GAIN 2
+#define FILTER_OFFSET 4
+
+/*
+	the filtered build must pop the same items as the heap offered, in
+	offset order, the good pixels of the materialized corrected frame; the
+	bad pixels come in runs, so some mask words are entirely set.
 */
-int32_t heap_min_pop(heap_t* heap) {
-  if (heap_empty(heap)) return -1;
+static void run_filter_test(uint16_t x, uint16_t y, uint32_t high_num,
+                            uint32_t parts) {
+  uint32_t size = (uint32_t)x * y;
+  uint64_t* mask = (uint64_t*)calloc((size + 63) / 64, sizeof(*mask));
+  float* gain = (float*)malloc(size * sizeof(*gain));
+  float* offset = (float*)malloc(size * sizeof(*offset));
+  high_pixels_filter_t filter = {parts & FILTER_MASK ? mask : NULL,
+                                 parts & FILTER_GAIN ? gain : NULL,
+                                 parts & FILTER_OFFSET ? offset : NULL};
+  heap_t filtered, reference;
+  image_t image;
+  rng_t rng;
+
+  if (!mask || !gain || !offset ||
+      init_image_ex(&image, x, y, (dist_t)((x + parts) % DIST_COUNT), y) ||
+      init_heap(&filtered, high_num) || init_heap(&reference, high_num))
+    exit(1);
+
+  rng_seed(&rng, (uint64_t)x << 32 | y << 8 | parts);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    uint64_t r = rng_next(&rng);
 
-  uint32_t* offsets = heap->offsets;
-  uint16_t* values = heap->values;
-  uint32_t size = heap->size - 1; /* new heap size */
-  uint32_t offset;
-  uint32_t parent; /* parent pointer */
-  uint16_t value;  /* tumble down value */
+    /* a 200 pixels bad run every 1000 pixels, else 1 bad pixel in 32 */
+    if (i % 1000 < 200 || !(r & 31)) mask[i / 64] |= 1ULL << i % 64;
 
-  heap->size = size;
+    /* saturating gains and offsets, now and then a NaN */
+    gain[i] = 0.5f + (r >> 8 & 0xffff) / 65536.0f;
+    offset[i] = (float)(int32_t)(r >> 24 & 0x3ff) - 512;
 
-  /* reach last element */
-  if (!size) return offsets[0];
+    if (!(r >> 40 & 0xff)) gain[i] = NAN;
+  }
+
+  /* every filter kernel must write the scalar values */
+  uint16_t* expected = (uint16_t*)malloc(size * sizeof(*expected));
+  uint16_t* corrected = (uint16_t*)malloc(size * sizeof(*corrected));
+
+  if (!expected || !corrected) exit(1);
+
+  for (scan_kernel_t k = SCAN_KERNEL_SCALAR;
+       (filter.gain || filter.offset) && k < SCAN_KERNEL_COUNT; ++k) {
+    filter_kernel_fn correct = filter_kernel_get(k);
 
-  /* if not the last element then tumble down root */
+    if (!correct) continue;
 
-  /* swap the last and the first element so the latter becomes the root */
-  SWAP(values[size], values[0], value);
-  SWAP(offsets[size], offsets[0], offset);
-  parent = 0;
+    filter_scalar(expected, image.pixels, filter.gain, filter.offset, size);
+    correct(corrected, image.pixels, filter.gain, filter.offset, size);
 
-  for (int32_t child = heap_min_child_for_parent(heap, parent);
-       /* stop if we reached the leaf level or reach insertion point */
-       child > 0 && value > values[child];
-       /* get child index with min value */
-       child = heap_min_child_for_parent(heap, parent)) {
-    /* upgrade child */
-    values[parent] = values[child];
-    offsets[parent] = offsets[child];
-    parent = child; /* move to child level */
+    if (memcmp(corrected, expected, size * sizeof(*expected))) {
+      printf("filter kernel %d tests failed :(\n", k);
+      exit(1);
+    }
   }
 
-  values[parent] = value;
-  offsets[parent] = offset;
+  free(corrected);
+  free(expected);
+
+  if (build_high_pixels_filtered(&image, &filter, &filtered) < 0) exit(1);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    if (filter.mask && mask[i / 64] >> i % 64 & 1) continue;
 
-  return offsets[size];
+    uint16_t value =
+        filter_pixel(image.pixels[i], filter.gain ? gain[i] : 1,
+                     filter.offset ? offset[i] : 0);
+
+    if (heap_min_offer(&reference, i, value) < 0) exit(1);
+  }
+
+  if (!heaps_match(&filtered, &reference)) {
+    printf("filter tests failed :(\n");
+    exit(1);
+  }
+
+  free_heap(&reference);
+  free_heap(&filtered);
+  free_image(&image);
+  free(offset);
+  free(gain);
+  free(mask);
 }
 
-/* prints heap_t object */
-void heap_print(const heap_t* heap, uint16_t columns) {
-  for (int32_t i = 0; i < heap->size; ++i)
-    printf(" [%d, %d, %hu] ", heap->offsets[i] / columns,
-           heap->offsets[i] % columns, heap->values[i]);
-  printf("\n");
+#define QUEUE_TEST_FRAMES 12
+
+typedef struct {
+  heap_t* references;
+  atomic_uint completed;
+  atomic_uint failed;
+} queue_test_t;
+
+/* checks the job result and hands its buffer back from the scan thread */
+static void queue_test_done(high_pixels_job_t* job, void* user) {
+  queue_test_t* test = (queue_test_t*)user;
+
+  if (job->status < 0 ||
+      !heaps_match(&job->heap, &test->references[job->frame]))
+    atomic_fetch_add(&test->failed, 1);
+
+  atomic_fetch_add(&test->completed, 1);
+  high_pixels_release(job);
 }
 
 /*
-	computes the first X high value pixels; X represents the heap size.
- */
-void build_high_pixels(const image_t* image, heap_t* high_pixels) {
-  if (!image_check_valid(image) || !heap_check_valid(high_pixels)) return;
+	queued frames must give the synchronous results: polled and waited jobs
+	on a double buffer, callbacks on a parallel triple buffer.
+*/
+static void run_queue_test(uint16_t x, uint16_t y, uint32_t high_num) {
+  image_t images[QUEUE_TEST_FRAMES];
+  heap_t references[QUEUE_TEST_FRAMES];
+  image_t invalid = {NULL, x, y};
+  high_pixels_queue_t queue;
+  high_pixels_job_t* jobs[2];
+  queue_test_t test;
+
+  for (uint32_t i = 0; i < QUEUE_TEST_FRAMES; ++i)
+    if (init_image_ex(&images[i], x, y, (dist_t)(i % DIST_COUNT), i) ||
+        init_heap(&references[i], high_num) ||
+        build_high_pixels(&images[i], &references[i]) < 0)
+      exit(1);
+
+  if (init_high_pixels_queue(&queue, 2, high_num, 1, NULL, NULL)) exit(1);
 
-  uint32_t size = image->size_x * image->size_y;
-  int32_t err = 0;
+  for (uint32_t i = 0; i < QUEUE_TEST_FRAMES; i += 2) {
+    if (!(jobs[0] = high_pixels_submit(&queue, &images[i])) ||
+        !(jobs[1] = high_pixels_submit(&queue, &images[i + 1])) ||
+        high_pixels_submit(&queue, &images[0]))
+      exit(1);
 
-  for (int32_t i = 0; i < size && err >= 0; ++i) {
-    /*
-        if heap reaches the desired capacity and the minimum heap value
-        is smaller than current pixel value then pop the heap in order to
-        make room for this pixel.
-    */
-    if (heap_full(high_pixels) && heap_peek(high_pixels) < image->pixels[i])
-      err = heap_min_pop(high_pixels);
+    for (uint32_t j = 0; j < 2; ++j) {
+      if (high_pixels_wait(jobs[j]) < 0 || !high_pixels_poll(jobs[j]) ||
+          jobs[j]->frame != i + j ||
+          !heaps_match(&jobs[j]->heap, &references[i + j])) {
+        printf("queue tests failed :(\n");
+        exit(1);
+      }
 
-    /*
-        if heap is not full then insert the pixel offset-value pair;
-        the offset will be used later to compute the pixel (x,y)
-		coordinates.
-    */
-    if (err >= 0 && !heap_full(high_pixels))
-      err = heap_min_push(high_pixels, i, image->pixels[i]);
+      high_pixels_release(jobs[j]);
+    }
+  }
+
+  /* the status of a failed build is reported, not swallowed */
+  if (!(jobs[0] = high_pixels_submit(&queue, &invalid)) ||
+      high_pixels_wait(jobs[0]) >= 0)
+    exit(1);
+
+  free_high_pixels_queue(&queue);
+
+  test.references = references;
+  atomic_init(&test.completed, 0);
+  atomic_init(&test.failed, 0);
+
+  if (init_high_pixels_queue(&queue, 3, high_num, 4, queue_test_done, &test))
+    exit(1);
+
+  /* capture side: a full ring is retried, it never blocks */
+  for (uint32_t i = 0; i < QUEUE_TEST_FRAMES; ++i)
+    while (!high_pixels_submit(&queue, &images[i])) sched_yield();
+
+  free_high_pixels_queue(&queue);
+
+  if (atomic_load(&test.completed) != QUEUE_TEST_FRAMES ||
+      atomic_load(&test.failed)) {
+    printf("queue callback tests failed :(\n");
+    exit(1);
+  }
+
+  for (uint32_t i = 0; i < QUEUE_TEST_FRAMES; ++i) {
+    free_heap(&references[i]);
+    free_image(&images[i]);
   }
 }
 
-static int32_t cmp(const void* a, const void* b) {
-  return (*(uint16_t*)a - *(uint16_t*)b);
+/* nested jobs: every worker of a pool job runs a parallel build */
+typedef struct {
+  const image_t* image;
+  heap_arena_t* arena;
+  atomic_int err;
+} pool_test_t;
+
+static void pool_test_worker(void* arg, uint32_t worker) {
+  pool_test_t* test = (pool_test_t*)arg;
+
+  if (build_high_pixels_parallel(test->image, &test->arena->heaps[worker], 3) <
+      0)
+    atomic_store(&test->err, -1);
 }
 
-/* tests a particular image size and top X pixel values */
-static void run_test(uint16_t x, uint16_t y, uint32_t high_num) {
-  uint32_t size = x * y;
-  heap_t high_pixels;
+/*
+	pool builds must match the sequential one, across pool reuse, nested
+	jobs falling back to their own threads and a pool restart.
+*/
+static void run_pool_test(uint16_t x, uint16_t y, dist_t dist,
+                          uint32_t high_num) {
   image_t image;
+  heap_t reference;
+  heap_arena_t arena;
+  pool_test_t test;
 
-  if (init_heap(&high_pixels, high_num)) exit(1);
-
-  if (init_image(&image, x, y)) {
-    free_heap(&high_pixels);
+  if (init_image_ex(&image, x, y, dist, x + y) ||
+      init_heap(&reference, high_num) ||
+      init_heap_arena(&arena, 4, high_num))
     exit(1);
+
+  build_high_pixels(&image, &reference);
+
+  for (uint32_t round = 0; round < 4; ++round) {
+    test.image = &image;
+    test.arena = &arena;
+    atomic_init(&test.err, 0);
+
+    for (uint32_t i = 0; i < 4; ++i) arena.heaps[i].size = 0;
+
+    if (round == 2) high_pixels_pool_stop();
+
+    /* the first round spawns the pool, the last one restarts it */
+    if (round & 1 ? run_workers(4, pool_test_worker, &test) ||
+                        atomic_load(&test.err)
+                  : build_high_pixels_bands(&image, &arena.heaps[0], 4, 1,
+                                            round == 0) < 0)
+      exit(1);
+
+    for (uint32_t i = 0; i < (round & 1 ? 4u : 1u); ++i) {
+      heap_t* heap = &arena.heaps[i];
+      heap_t expected;
+
+      if (init_heap(&expected, high_num)) exit(1);
+
+      expected.size = reference.size;
+      memcpy(expected.offsets, reference.offsets,
+             reference.size * sizeof(*reference.offsets));
+      memcpy(expected.values, reference.values,
+             reference.size * sizeof(*reference.values));
+
+      if (heap->size != expected.size) exit(1);
+
+      for (; expected.size; heap_min_pop(heap), heap_min_pop(&expected))
+        if (heap->offsets[0] != expected.offsets[0] ||
+            heap->values[0] != expected.values[0]) {
+          printf("pool tests failed :(\n");
+          exit(1);
+        }
+
+      free_heap(&expected);
+    }
   }
 
-  /* build the top X pixel heap */
-  build_high_pixels(&image, &high_pixels);
+  free_heap_arena(&arena);
+  free_heap(&reference);
+  free_image(&image);
+}
+
+/* the generated images must only depend on the seed */
+static void run_fill_test(uint16_t x, uint16_t y) {
+  for (dist_t d = DIST_UNIFORM; d < DIST_COUNT; ++d) {
+    image_t serial, parallel;
+    uint32_t size = (uint32_t)x * y;
+    uint16_t max = 0;
 
-  /* test against well known qsort */
-  qsort(image.pixels, size, sizeof(uint16_t), cmp);
+    if (init_image_ex(&serial, x, y, d, 42) ||
+        init_image_ex(&parallel, x, y, d, 7) ||
+        fill_image(&parallel, d, 42, 3))
+      exit(1);
 
-  uint32_t off = size > high_num ? high_num : size;
-  uint16_t* start = image.pixels + (size - off);
-  uint16_t* end = image.pixels + size;
+    for (uint32_t i = 0; i < size; ++i)
+      if (serial.pixels[i] > max) max = serial.pixels[i];
 
-  for (; start != end; start++) {
-    heap_min_pop(&high_pixels);
-    if (*start != high_pixels.values[high_pixels.size]) {
-      heap_print(&high_pixels, image.size_y);
-      printf("tests failed :(\n");
+    if (memcmp(serial.pixels, parallel.pixels, size * sizeof(uint16_t)) ||
+        (d == DIST_UNIFORM && max <= UINT8_MAX)) {
+      printf("fill tests failed :(\n");
       exit(1);
     }
+
+    free_image(&serial);
+    free_image(&parallel);
+  }
+}
+
+/* tests a batch of frames of different sizes against build_high_pixels() */
+static void run_batch_test(uint32_t frames, uint32_t high_num) {
+  image_t* images = (image_t*)calloc(frames, sizeof(*images));
+  heap_arena_t arena;
+
+  if (!images || init_heap_arena(&arena, frames + 1, high_num)) exit(1);
+
+  for (uint32_t i = 0; i < frames; ++i)
+    if (init_image(&images[i], 1 + i * 7 % 61, 1 + i * 13 % 67)) exit(1);
+
+  /* the second round reuses the arena, as in steady state */
+  for (uint32_t round = 0; round < 2; ++round) {
+    if (build_high_pixels_batch(images, frames, &arena, 3) < 0) exit(1);
+
+    for (uint32_t i = 0; i < frames; ++i) {
+      heap_t high_pixels;
+      heap_t* heap = &arena.heaps[i];
+
+      if (init_heap(&high_pixels, high_num)) exit(1);
+
+      build_high_pixels(&images[i], &high_pixels);
+
+      if (heap->size != high_pixels.size ||
+          memcmp(heap->values, high_pixels.values,
+                 high_pixels.size * sizeof(*high_pixels.values)) ||
+          memcmp(heap->offsets, high_pixels.offsets,
+                 high_pixels.size * sizeof(*high_pixels.offsets))) {
+        heap_print(heap, images[i].size_y);
+        printf("batch tests failed :(\n");
+        exit(1);
+      }
+
+      free_heap(&high_pixels);
+    }
   }
 
+  for (uint32_t i = 0; i < frames; ++i) free_image(&images[i]);
+
+  free_heap_arena(&arena);
+  free(images);
+}
+
+/*
+	a steady state batch must not allocate per frame, whatever engine
+	ENGINE_AUTO picks: a batch of 3 times the frames makes the same
+	allocations (the workers only).
+*/
+static void run_batch_alloc_test(uint16_t x, uint16_t y, uint32_t high_num) {
+  image_t image, images[9];
+  heap_arena_t arena;
+  uint32_t allocations[2];
+
+  if (init_image(&image, x, y) || init_heap_arena(&arena, 9, high_num))
+    exit(1);
+
+  for (uint32_t i = 0; i < 9; ++i) images[i] = image;
+
+  /* warm up, the pool keeps its threads and scratch */
+  if (build_high_pixels_batch(images, 9, &arena, 3) < 0) exit(1);
+
+  for (uint32_t round = 0; round < 2; ++round) {
+    uint32_t before = atomic_load(&test_allocations);
+
+    if (build_high_pixels_batch(images, round ? 9 : 3, &arena, 3) < 0)
+      exit(1);
+
+    allocations[round] = atomic_load(&test_allocations) - before;
+  }
+
+  if (allocations[0] != allocations[1]) {
+    printf("batch allocation tests failed :(\n");
+    exit(1);
+  }
+
+  free_heap_arena(&arena);
   free_image(&image);
-  free_heap(&high_pixels);
 }
 
-int main() {
+static const char* test_option(const char* arg, const char* name) {
+  size_t len = strlen(name);
+
+  return !strncmp(arg, name, len) && arg[len] == '=' ? arg + len + 1 : NULL;
+}
+
+static void test_usage(void) {
+  printf(
+      "usage: highpixel [--property [options]]\n"
+      "  without options  the full test suite\n"
+      "  --property       only the randomized property tests\n"
+      "  --seed=N         property tests seed (default 1)\n"
+      "  --rounds=N       property tests rounds (default 100)\n"
+      "  --min-pixels=N   smallest image pixel count (default 1)\n"
+      "  --max-pixels=N   largest image pixel count (default 1048576)\n");
+}
+
+int main(int argc, char** argv) {
+  uint64_t seed = 1;
+  uint32_t rounds = 100, min_pixels = 1, max_pixels = 1 << 20;
+  int8_t property = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* v;
+
+    if ((v = test_option(argv[i], "--seed")))
+      seed = strtoull(v, NULL, 10);
+    else if ((v = test_option(argv[i], "--rounds")))
+      rounds = (uint32_t)atoi(v);
+    else if ((v = test_option(argv[i], "--min-pixels")))
+      min_pixels = (uint32_t)atoll(v);
+    else if ((v = test_option(argv[i], "--max-pixels")))
+      max_pixels = (uint32_t)atoll(v);
+    else if (!strcmp(argv[i], "--property"))
+      property = 1;
+    else {
+      test_usage();
+      return strcmp(argv[i], "--help") ? 1 : 0;
+    }
+  }
+
+  if (!max_pixels || min_pixels > max_pixels) {
+    test_usage();
+    return 1;
+  }
+
+  if (property) {
+    run_property_test(seed, rounds, min_pixels, max_pixels);
+    printf("\nAll test passed :)\n");
+
+    return 0;
+  }
+
+  run_tile_test(1, 1, 64, 64, 8);
+  run_tile_test(200, 301, 64, 64, 8);
+  run_tile_test(97, 130, 7, 33, 16);
+  run_tile_test(64, 64, 1, 1, 1);
+
+  run_wide_test(1, 1, 0, 1);
+  run_wide_test(300, 200, 0, 50);
+  run_wide_test(3, 70001, 0, 50);
+  run_wide_test(2, 100000, 0, 3000);
+  run_wide_test(97, 130, 1000, 50);
+  run_wide_test(97, 130, 7, 9000);
+  run_wide_spikes_test(40000, 60000, 48);
+
+  for (uint16_t x = 1; x <= 4 * IMAGE_SIZE_X; x += 43)
+    for (uint16_t y = 1; y <= 4 * IMAGE_SIZE_Y; y += 29) {
+      run_typed_test(x, y, 1);
+      run_typed_test(x, y, HIGH_PIXELS_NUM);
+      run_typed_test(x, y, 2500);
+    }
+
+  run_stats_test();
+
+  run_queue_test(1, 1, 1);
+  run_queue_test(300, 200, HIGH_PIXELS_NUM);
+  run_queue_test(97, 130, 2000);
+
+  run_heap_key_test(0, 10);
+  run_heap_key_test(1, 1000);
+  run_heap_key_test(HIGH_PIXELS_NUM, 100000);
+  run_heap_key_test(HEAP_PREFETCH_ITEMS + 3, 200000);
+
+  for (uint16_t x = 1; x <= 4 * IMAGE_SIZE_X; x += 43)
+    for (uint16_t y = 1; y <= 4 * IMAGE_SIZE_Y; y += 29) {
+      run_seed_test(x, y, 1, ENGINE_PACKED);
+      run_seed_test(x, y, HIGH_PIXELS_NUM, ENGINE_PACKED);
+
+      for (uint32_t high_num = 1; high_num <= 17; high_num += 3)
+        run_seed_test(x, y, high_num, ENGINE_SMALL);
+    }
+
+  for (uint32_t parts = 0; parts < 8; ++parts) {
+    run_filter_test(1, 1, 1, parts);
+    run_filter_test(61, 67, 5, parts);
+    run_filter_test(300, 200, HIGH_PIXELS_NUM, parts);
+    run_filter_test(97, 130, 3000, parts);
+  }
+
+  if (high_pixels_pool_start(4)) exit(1);
+
+  run_pool_test(1, 1, DIST_UNIFORM, HIGH_PIXELS_NUM);
+  run_pool_test(300, 200, DIST_UNIFORM8, HIGH_PIXELS_NUM);
+  run_pool_test(300, 200, DIST_ASCENDING, 700);
+  run_pool_test(257, 61, DIST_DESCENDING, 3);
+
+  for (uint16_t x = 1; x <= 4 * IMAGE_SIZE_X; x += 43)
+    for (uint16_t y = 1; y <= 4 * IMAGE_SIZE_Y; y += 29) {
+      run_approx_test(x, y, 1, 0);
+      run_approx_test(x, y, HIGH_PIXELS_NUM, 0);
+      run_approx_test(x, y, HIGH_PIXELS_NUM, 3);
+      run_approx_test(x, y, 3000, 101);
+    }
+
+  for (uint16_t x = 1; x <= 4 * IMAGE_SIZE_X; x += 43)
+    for (uint16_t y = 1; y <= 4 * IMAGE_SIZE_Y; y += 29) {
+      run_extreme_test(x, y, HIGH_PIXELS_NUM, HIGH_PIXELS_NUM);
+      run_extreme_test(x, y, 0, 7);
+      run_extreme_test(x, y, 3000, 1);
+      run_extreme_test(x, y, 1, 0);
+    }
+
+#ifdef HIGH_PIXEL_GPU
+  for (uint16_t x = 1; x <= 4 * IMAGE_SIZE_X; x += 51)
+    for (uint16_t y = 1; y <= 4 * IMAGE_SIZE_Y; y += 37) {
+      run_gpu_test(x, y, 1);
+      run_gpu_test(x, y, HIGH_PIXELS_NUM);
+      run_gpu_test(x, y, 9000);
+    }
+
+  run_gpu_test(4096, 4096, 1000);
+#endif
+
+  run_temporal_test(1, 1, 1);
+  run_temporal_test(64, 64, HIGH_PIXELS_NUM);
+  run_temporal_test(300, 200, HIGH_PIXELS_NUM);
+  run_temporal_test(300, 200, 5000);
+  run_temporal_test(17, 3, 100);
+  run_temporal_test(300, 200, 0);
+
+  run_shared_test(300, 200, 0, 4);
+  run_shared_test(300, 200, HIGH_PIXELS_NUM, 4);
+  run_shared_test(1, 1, 0, 2);
+  run_shared_test(1024, 64, 5000, 3);
+
+  run_stack_test(1, 1, 1, 1);
+  run_stack_test(7, 64, 64, HIGH_PIXELS_NUM);
+  run_stack_test(16, 300, 200, HIGH_PIXELS_NUM);
+  run_stack_test(16, 300, 200, 5000);
+  run_stack_test(5, 3, 4, 100);
+
+  run_fill_test(1, 1);
+  run_fill_test(512, 300);
+
+  run_batch_test(64, HIGH_PIXELS_NUM);
+  run_batch_test(16, 1000);
+  run_batch_alloc_test(IMAGE_SIZE_X, IMAGE_SIZE_Y, 4);
+  run_batch_alloc_test(IMAGE_SIZE_X, IMAGE_SIZE_Y, HIGH_PIXELS_NUM);
+  run_batch_alloc_test(IMAGE_SIZE_X, IMAGE_SIZE_Y, 1000);
+  run_batch_alloc_test(1024, 1024, 1000);
+
+  for (uint16_t x = 1; x <= 17; x += 4)
+    for (uint16_t y = 1; y <= 17; y += 4) run_load_test(x, y);
+
   for (uint16_t x = 1; x <= IMAGE_SIZE_X; ++x)
     for (uint16_t y = 1; y <= IMAGE_SIZE_Y; ++y)
       run_test(x, y, HIGH_PIXELS_NUM);
 
+  /* tiny X, every slots count of the small engine */
+  for (uint16_t x = 1; x <= IMAGE_SIZE_X; x += 7)
+    for (uint16_t y = 1; y <= IMAGE_SIZE_Y; y += 5)
+      for (uint32_t high_num = 2; high_num <= 17; ++high_num)
+        run_test(x, y, high_num);
+
+  /* large X, any capacity is accepted */
+  for (uint16_t x = 1; x <= 4 * IMAGE_SIZE_X; x += 51)
+    for (uint16_t y = 1; y <= 4 * IMAGE_SIZE_Y; y += 37) {
+      run_test(x, y, 1);
+      run_test(x, y, 2500);
+      run_test(x, y, 9000);
+    }
+
+  run_property_test(seed, rounds, min_pixels, max_pixels);
+
   printf("\nAll test passed :)\n");
 
   return 0;
-}
\ No newline at end of file
+}